@@ -0,0 +1,1556 @@
+/**
+ * bench.c - Benchmark suite for the SHA-256 kernels and entry points.
+ *
+ *   gcc -O2 -pthread -DSHA256_NO_MAIN -o bench bench.c sha256.c sha256_queue.c -lm
+ *   ./bench [options]
+ *
+ * Every supported kernel is measured through each API over message sizes
+ * from 0 bytes to 1 GiB in powers of two:
+ *
+ *   compress  sha256_compress() over whole blocks, no padding
+ *   oneshot   sha256_hash()
+ *   stream    sha256_init() / sha256_update() in 16 KiB pieces / sha256_final()
+ *   batch     sha256_hash_batch() of 8 messages (while 8 fit in the buffer)
+ *
+ * The avx2x8 kernel only changes the batch path, so it is only run there.
+ * Each case is warmed up, then timed over several trials of at least
+ * -T milliseconds each; the table shows the mean and a 95% confidence
+ * interval. Cycles come from the TSC, which ticks at a constant reference
+ * rate, so cycles/byte is in reference cycles.
+ *
+ * -m sweep hashes a working set that grows from 4 KiB to 8x the last-level
+ * cache (or -M bytes), split into -C byte messages (4096) and hashed with
+ * sha256_hash_batch(), on one thread and on every CPU. Each pass reads the
+ * working set once, so the hashing throughput is also the memory bandwidth
+ * it consumes. It is shown next to the bandwidth of a plain read pass over
+ * the same working set: where the two meet, hashing is memory-bound.
+ *
+ * -m scaling runs three workloads on 1, 2, 4, ... up to all CPUs, with SMT
+ * off (one CPU per core) and on (siblings filled pairwise):
+ *
+ *   batch   -C byte messages through sha256_hash_batch()
+ *   stream  1 MiB messages through the streaming API, like hashing files
+ *   queue   producers submitting -C byte jobs to one sha256_queue
+ *
+ * Strong scaling splits 64 MiB (or -M) over the threads; weak scaling gives
+ * each thread that much. Efficiency is speedup over the one-thread run
+ * divided by the thread count; below 80% a likely cause is named: memory
+ * bandwidth (when hashing runs near a plain read of the same data), SMT
+ * siblings, or queue contention.
+ *
+ * -m replay -R file regenerates traffic from a size histogram recorded by a
+ * library built with -DSHA256_RECORD (see sha256.h): up to 64 MiB (-M) of
+ * messages drawn from the recorded lengths, optionally of one API (-a),
+ * hashed with every kernel one at a time, in batches of 8, 16 and 64, all
+ * in one batch, and in batches drawn from the recorded batch sizes.
+ *
+ * -m counters reads hardware counters with perf_event_open() around each
+ * kernel and API at 64 B, 256 B, ... up to 1 MiB (-M) and prints per-block
+ * cycles, instructions, IPC, uops, branch misses, L1D misses and the share
+ * of cycles the front end delivered nothing. The kernels run message
+ * schedule and rounds interleaved, so they cannot be split; padding shows
+ * up as the difference between compress and oneshot at small sizes.
+ * Events are read in two groups so each is counted without multiplexing;
+ * events the CPU or kernel lacks are shown as "-".
+ *
+ * -m energy reads the RAPL package and DRAM energy counters under
+ * /sys/class/powercap (Intel, and AMD through the same driver) around
+ * trials of -C byte messages through sha256_hash_batch(), 64 MiB (-M) per
+ * thread, for every kernel on 1, 2, 4, ... up to all CPUs, and reports
+ * watts, joules per GiB and hashes per joule next to the idle power.
+ * Without readable counters it still reports throughput.
+ *
+ * Options:
+ *   -m mode    sizes, sweep, scaling, replay, counters or energy
+ *   -s bytes   smallest size (0)         -M bytes   largest size or working set
+ *   -k name    only this kernel          -a name    only this API or workload
+ *   -r n       trials per case (7)       -T ms      minimum trial time (20)
+ *   -c cpu     pin to this CPU           -j file    also write JSON results
+ *   -C bytes   message size for sweep, scaling and energy
+ *   -R file    histogram to replay
+ *
+ * Byte counts take a K, M or G suffix.
+ */
+#define _GNU_SOURCE
+#include <glob.h>
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <cpuid.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <x86intrin.h>
+
+#include "sha256.h"
+#include "sha256_queue.h"
+
+#define BATCH 8
+#define STREAM_PIECE 16384
+#define MAX_TRIALS 64
+#define SCALE_WORK (64ULL << 20)
+#define SCALE_FILE (1ULL << 20)
+#define SCALE_WINDOW 64
+
+typedef struct {
+  unsigned char* buf;
+  uint64_t buflen;
+  uint64_t size;
+  const unsigned char* msgs[BATCH];
+  uint64_t lens[BATCH];
+  unsigned char* outs[BATCH];
+  unsigned char digests[BATCH][32];
+} bench_case;
+
+typedef struct {
+  const char* name;
+  void (*run)(bench_case* bc);
+  int hashes;                 // messages per call
+  int any_kernel;             // meaningful for the x8 kernel too
+} bench_api;
+
+typedef struct {
+  double mean;
+  double ci95;                // half-width
+} bench_stat;
+
+typedef struct {
+  uint64_t min_size;
+  uint64_t max_size;
+  const char* kernel;
+  const char* api;
+  int trials;
+  double min_trial_ns;
+  int cpu;
+  uint64_t chunk;
+  const char* replay;
+  FILE* json;
+  int json_first;
+} bench_opts;
+
+static volatile unsigned char sink;
+static double tsc_ghz;
+
+// CPUs the process may run on, captured before the main thread is pinned.
+static int cpus[CPU_SETSIZE];
+static int ncpus;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline uint64_t tsc_begin(void) {
+  _mm_lfence();
+  return __rdtsc();
+}
+
+static inline uint64_t tsc_end(void) {
+  unsigned int aux;
+  uint64_t t = __rdtscp(&aux);
+  _mm_lfence();
+  return t;
+}
+
+// TSC ticks per nanosecond, measured against the monotonic clock.
+static double calibrate_tsc(void) {
+  uint64_t t0 = now_ns(), c0 = tsc_begin();
+  while (now_ns() - t0 < 50000000) {
+  }
+  uint64_t t1 = now_ns(), c1 = tsc_end();
+  return (double)(c1 - c0) / (t1 - t0);
+}
+
+static void run_compress(bench_case* bc) {
+  uint32_t H[8] = { 0 };
+  sha256_compress(H, bc->buf, bc->size / 64);
+  sink ^= (unsigned char)H[0];
+}
+
+static void run_oneshot(bench_case* bc) {
+  sha256_hash(bc->buf, bc->size, bc->digests[0]);
+  sink ^= bc->digests[0][0];
+}
+
+static void run_stream(bench_case* bc) {
+  sha256_ctx ctx;
+  sha256_init(&ctx);
+  for (uint64_t off = 0; off < bc->size; off += STREAM_PIECE) {
+    uint64_t n = bc->size - off < STREAM_PIECE ? bc->size - off : STREAM_PIECE;
+    sha256_update(&ctx, bc->buf + off, n);
+  }
+  sha256_final(&ctx, bc->digests[0]);
+  sink ^= bc->digests[0][0];
+}
+
+static void run_batch(bench_case* bc) {
+  sha256_hash_batch(bc->msgs, bc->lens, BATCH, bc->outs);
+  sink ^= bc->digests[BATCH-1][0];
+}
+
+static const bench_api apis[] = {
+  { "compress", run_compress, 1, 0 },
+  { "oneshot", run_oneshot, 1, 0 },
+  { "stream", run_stream, 1, 0 },
+  { "batch", run_batch, BATCH, 1 },
+};
+
+// Two-sided 95% Student t quantiles for 1..30 degrees of freedom.
+static const double t95[] = {
+  12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+  2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+  2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+};
+
+static bench_stat summarize(const double* x, int n) {
+  bench_stat st = { 0, 0 };
+  for (int i = 0; i < n; i++) {
+    st.mean += x[i];
+  }
+  st.mean /= n;
+  if (n > 1) {
+    double var = 0;
+    for (int i = 0; i < n; i++) {
+      var += (x[i] - st.mean) * (x[i] - st.mean);
+    }
+    var /= n - 1;
+    st.ci95 = (n - 1 <= 30 ? t95[n - 2] : 1.96) * sqrt(var / n);
+  }
+  return st;
+}
+
+static void pin_cpu(int cpu) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+    perror("sched_setaffinity");
+  }
+}
+
+static void list_cpus(void) {
+  cpu_set_t set;
+  ncpus = 0;
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (int i = 0; i < CPU_SETSIZE; i++) {
+      if (CPU_ISSET(i, &set)) {
+        cpus[ncpus++] = i;
+      }
+    }
+  }
+  if (ncpus == 0) {
+    cpus[ncpus++] = sched_getcpu();
+  }
+}
+
+typedef struct {
+  void (*fn)(void* arg, int tid, int nthreads);
+  void* arg;
+  int tid;
+  int nthreads;
+  int cpu;
+  pthread_barrier_t* start;
+} bench_thread;
+
+static void* bench_thread_main(void* p) {
+  bench_thread* t = p;
+  pin_cpu(t->cpu);
+  pthread_barrier_wait(t->start);
+  t->fn(t->arg, t->tid, t->nthreads);
+  return NULL;
+}
+
+// Run fn on nthreads threads, thread i pinned to on[i], all released at
+// once. Returns the wall time in ns from release until the last one is done.
+static double run_parallel(int nthreads, const int* on, void (*fn)(void*, int, int), void* arg) {
+  pthread_t th[CPU_SETSIZE];
+  bench_thread bt[CPU_SETSIZE];
+  pthread_barrier_t start;
+
+  pthread_barrier_init(&start, NULL, nthreads + 1);
+  for (int i = 0; i < nthreads; i++) {
+    bt[i] = (bench_thread){ fn, arg, i, nthreads, on[i], &start };
+    pthread_create(&th[i], NULL, bench_thread_main, &bt[i]);
+  }
+  pthread_barrier_wait(&start);
+  uint64_t t0 = now_ns();
+  for (int i = 0; i < nthreads; i++) {
+    pthread_join(th[i], NULL);
+  }
+  double ns = now_ns() - t0;
+  pthread_barrier_destroy(&start);
+  return ns;
+}
+
+static void cpu_model(char* out, size_t len) {
+  char line[256];
+  FILE* f = fopen("/proc/cpuinfo", "r");
+  snprintf(out, len, "unknown");
+  while (f != NULL && fgets(line, sizeof(line), f) != NULL) {
+    char* colon = strchr(line, ':');
+    if (strncmp(line, "model name", 10) == 0 && colon != NULL) {
+      snprintf(out, len, "%s", colon + 2);
+      out[strcspn(out, "\n")] = 0;
+      break;
+    }
+  }
+  if (f != NULL) {
+    fclose(f);
+  }
+}
+
+/*
+ * Time one case: warm up, pick an iteration count that makes a trial last
+ * at least min_trial_ns, then run the trials. Fills per-hash nanoseconds
+ * and cycles/byte.
+ */
+static void measure(const bench_api* api, bench_case* bc, const bench_opts* o,
+                    bench_stat* ns_per_hash, bench_stat* cpb) {
+  double ns[MAX_TRIALS], cyc[MAX_TRIALS];
+  uint64_t bytes = bc->size * api->hashes;
+
+  api->run(bc);
+  uint64_t t0 = now_ns();
+  api->run(bc);
+  uint64_t one = now_ns() - t0 + 1;
+  uint64_t iters = o->min_trial_ns > one ? (uint64_t)(o->min_trial_ns / one) : 1;
+
+  for (int t = 0; t < o->trials; t++) {
+    uint64_t c0 = tsc_begin();
+    for (uint64_t i = 0; i < iters; i++) {
+      api->run(bc);
+    }
+    uint64_t c1 = tsc_end();
+    double per_call = (double)(c1 - c0) / iters;
+    ns[t] = per_call / tsc_ghz / api->hashes;
+    cyc[t] = bytes ? per_call / bytes : 0;
+  }
+  *ns_per_hash = summarize(ns, o->trials);
+  *cpb = summarize(cyc, o->trials);
+}
+
+// Start the next element of the JSON results array; returns the stream, or
+// NULL when no JSON is being written.
+static FILE* json_next(bench_opts* o) {
+  if (o->json != NULL) {
+    fprintf(o->json, "%s\n    ", o->json_first ? "" : ",");
+    o->json_first = 0;
+  }
+  return o->json;
+}
+
+// Allocate and fill a buffer for cases of up to max_size bytes.
+static int case_alloc(bench_case* bc, uint64_t max_size) {
+  bc->buflen = max_size > 8 * BATCH * 64 ? max_size : 8 * BATCH * 64;
+  bc->buf = malloc(bc->buflen);
+  if (bc->buf == NULL) {
+    perror("malloc");
+    return -1;
+  }
+  for (uint64_t i = 0; i < bc->buflen; i++) {
+    bc->buf[i] = (unsigned char)(i * 2654435761u >> 24);
+  }
+  for (int i = 0; i < BATCH; i++) {
+    bc->outs[i] = bc->digests[i];
+  }
+  return 0;
+}
+
+static void case_size(bench_case* bc, uint64_t size) {
+  bc->size = size;
+  for (int i = 0; i < BATCH; i++) {
+    bc->msgs[i] = bc->buf + i * size;
+    bc->lens[i] = size;
+  }
+}
+
+static void mode_sizes(bench_opts* o) {
+  bench_case bcase = { 0 };
+  bench_case* bc = &bcase;
+
+  if (o->max_size == 0) {
+    o->max_size = 1ULL << 30;
+  }
+  if (case_alloc(bc, o->max_size) != 0) {
+    return;
+  }
+
+  printf("%-8s %-9s %12s %14s %10s %16s %10s\n", "kernel", "api", "size", "ns/hash", "+-95%",
+         "cycles/byte", "MB/s");
+
+  for (int k = SHA256_KERNEL_SCALAR; k < SHA256_NKERNELS; k++) {
+    const char* kname = sha256_kernel_name(k);
+    if (!sha256_kernel_supported(k) || (o->kernel != NULL && strcmp(o->kernel, kname) != 0)) {
+      continue;
+    }
+    sha256_set_kernel(k);
+
+    for (unsigned a = 0; a < sizeof(apis) / sizeof(apis[0]); a++) {
+      const bench_api* api = &apis[a];
+      if ((k == SHA256_KERNEL_AVX2_X8 && !api->any_kernel) ||
+          (o->api != NULL && strcmp(o->api, api->name) != 0)) {
+        continue;
+      }
+
+      for (uint64_t size = o->min_size; size <= o->max_size; size = size ? 2 * size : 1) {
+        if (size * api->hashes > bc->buflen) {
+          break;
+        }
+        if (api->run == run_compress && size < 64) {
+          continue;
+        }
+        case_size(bc, size);
+
+        bench_stat ns, cpb;
+        measure(api, bc, o, &ns, &cpb);
+        printf("%-8s %-9s %12llu %14.1f %10.1f %16.3f %10.1f\n", kname, api->name,
+               (unsigned long long)size, ns.mean, ns.ci95, cpb.mean, size / ns.mean * 1e3);
+        fflush(stdout);
+
+        FILE* j = json_next(o);
+        if (j != NULL) {
+          fprintf(j, "{\"mode\": \"sizes\", \"kernel\": \"%s\", \"api\": \"%s\", "
+                  "\"size\": %llu, \"trials\": %d, \"ns_per_hash\": %.3f, "
+                  "\"ns_per_hash_ci95\": %.3f, \"cycles_per_byte\": %.4f, "
+                  "\"cycles_per_byte_ci95\": %.4f}", kname, api->name,
+                  (unsigned long long)size, o->trials, ns.mean, ns.ci95, cpb.mean, cpb.ci95);
+        }
+      }
+    }
+  }
+  sha256_set_kernel(SHA256_KERNEL_AUTO);
+  free(bc->buf);
+}
+
+/*
+ * Working-set sweep.
+ */
+typedef struct {
+  unsigned char* buf;
+  uint64_t ws;
+  uint64_t chunk;
+  uint64_t passes;
+  int read_only;
+} sweep_work;
+
+// Plain read of every 8-byte word, four independent chains.
+static uint64_t read_pass(const unsigned char* p, uint64_t len) {
+  const uint64_t* w = (const uint64_t*)p;
+  uint64_t a = 0, b = 0, c = 0, d = 0;
+  for (uint64_t i = 0; i + 4 <= len / 8; i += 4) {
+    a += w[i];
+    b ^= w[i+1];
+    c += w[i+2];
+    d ^= w[i+3];
+  }
+  return a ^ b ^ c ^ d;
+}
+
+// Thread tid's share of the working set, as whole messages.
+static void sweep_region(const sweep_work* w, int tid, int nthreads, unsigned char** p,
+                         uint64_t* len, uint64_t* chunk) {
+  uint64_t per = w->ws / nthreads;
+  *chunk = w->chunk < per ? w->chunk : per;
+  *len = per - per % *chunk;
+  *p = w->buf + (uint64_t)tid * per;
+}
+
+static void sweep_thread(void* arg, int tid, int nthreads) {
+  const sweep_work* w = arg;
+  unsigned char* p;
+  uint64_t len, chunk;
+  uint64_t acc = 0;
+
+  sweep_region(w, tid, nthreads, &p, &len, &chunk);
+  if (w->read_only) {
+    for (uint64_t k = 0; k < w->passes; k++) {
+      acc += read_pass(p, len);
+    }
+    sink ^= (unsigned char)acc;
+    return;
+  }
+
+  const unsigned char* msgs[BATCH];
+  uint64_t lens[BATCH];
+  unsigned char digests[BATCH][32];
+  unsigned char* outs[BATCH];
+  for (int i = 0; i < BATCH; i++) {
+    lens[i] = chunk;
+    outs[i] = digests[i];
+  }
+  for (uint64_t k = 0; k < w->passes; k++) {
+    for (uint64_t off = 0; off < len; off += BATCH * chunk) {
+      int n = 0;
+      for (; n < BATCH && off + n * chunk < len; n++) {
+        msgs[n] = p + off + n * chunk;
+      }
+      sha256_hash_batch(msgs, lens, n, outs);
+    }
+  }
+  sink ^= digests[0][0];
+}
+
+// GB/s of w over o->trials trials on nthreads threads.
+static bench_stat sweep_measure(const bench_opts* o, sweep_work* w, int nthreads) {
+  double gbs[MAX_TRIALS];
+
+  // Grow the pass count until thread start-up is noise next to the work.
+  w->passes = 1;
+  double ns = run_parallel(nthreads, cpus, sweep_thread, w);
+  while (ns < o->min_trial_ns / 2) {
+    w->passes *= 2;
+    ns = run_parallel(nthreads, cpus, sweep_thread, w);
+  }
+  w->passes = (uint64_t)(w->passes * o->min_trial_ns / ns) + 1;
+
+  for (int t = 0; t < o->trials; t++) {
+    double ns = run_parallel(nthreads, cpus, sweep_thread, w);
+    gbs[t] = (double)w->ws * w->passes / ns;
+  }
+  return summarize(gbs, o->trials);
+}
+
+static uint64_t cache_size(int name) {
+  long v = sysconf(name);
+  return v > 0 ? (uint64_t)v : 0;
+}
+
+static void mode_sweep(bench_opts* o) {
+  uint64_t l1 = cache_size(_SC_LEVEL1_DCACHE_SIZE);
+  uint64_t l2 = cache_size(_SC_LEVEL2_CACHE_SIZE);
+  uint64_t l3 = cache_size(_SC_LEVEL3_CACHE_SIZE);
+  uint64_t llc = l3 ? l3 : l2;
+
+  // 8x the LLC, but at most a quarter of RAM.
+  uint64_t max_ws = o->max_size;
+  if (max_ws == 0) {
+    uint64_t ram = cache_size(_SC_PHYS_PAGES) * cache_size(_SC_PAGESIZE);
+    max_ws = llc ? 8 * llc : 1ULL << 30;
+    if (ram > 0 && max_ws > ram / 4) {
+      max_ws = ram / 4;
+    }
+  }
+
+  sweep_work w = { 0 };
+  w.chunk = o->chunk;
+  w.buf = aligned_alloc(64, max_ws + 64);
+  if (w.buf == NULL) {
+    perror("aligned_alloc");
+    return;
+  }
+  for (uint64_t i = 0; i < max_ws; i++) {
+    w.buf[i] = (unsigned char)(i * 2654435761u >> 24);
+  }
+
+  printf("L1d %llu KiB, L2 %llu KiB, LLC %llu KiB; %llu-byte messages, kernel %s\n",
+         (unsigned long long)l1 >> 10, (unsigned long long)l2 >> 10,
+         (unsigned long long)llc >> 10, (unsigned long long)w.chunk,
+         sha256_kernel_name(sha256_get_kernel()));
+  printf("%12s %5s %7s %10s %8s %10s %8s\n", "working set", "level", "threads", "hash GB/s",
+         "+-95%", "read GB/s", "hash/rd");
+
+  int counts[2] = { 1, ncpus };
+  for (uint64_t ws = 4096; ws <= max_ws; ws *= 2) {
+    const char* level = ws <= l1 ? "L1" : ws <= l2 ? "L2" : ws <= llc ? "LLC" : "DRAM";
+    w.ws = ws;
+
+    for (int c = 0; c < (ncpus > 1 ? 2 : 1); c++) {
+      int nthreads = counts[c];
+      if (ws / nthreads < 64) {
+        continue;
+      }
+      w.read_only = 0;
+      bench_stat hash = sweep_measure(o, &w, nthreads);
+      w.read_only = 1;
+      bench_stat rd = sweep_measure(o, &w, nthreads);
+
+      printf("%12llu %5s %7d %10.3f %8.3f %10.3f %7.1f%%\n", (unsigned long long)ws, level,
+             nthreads, hash.mean, hash.ci95, rd.mean, 100 * hash.mean / rd.mean);
+      fflush(stdout);
+
+      FILE* j = json_next(o);
+      if (j != NULL) {
+        fprintf(j, "{\"mode\": \"sweep\", \"working_set\": %llu, \"level\": \"%s\", "
+                "\"threads\": %d, \"chunk\": %llu, \"hash_gbps\": %.4f, "
+                "\"hash_gbps_ci95\": %.4f, \"read_gbps\": %.4f}", (unsigned long long)ws,
+                level, nthreads, (unsigned long long)w.chunk, hash.mean, hash.ci95, rd.mean);
+      }
+    }
+  }
+  free(w.buf);
+}
+
+/*
+ * Scaling.
+ */
+typedef struct {
+  const char* name;
+  void (*fn)(void* arg, int tid, int nthreads);
+} scale_workload;
+
+typedef struct {
+  unsigned char* buf;
+  uint64_t per_thread;     // bytes each thread hashes
+  uint64_t chunk;          // message size
+  sha256_queue* q;
+} scale_work;
+
+static void scale_batch(void* arg, int tid, int nthreads) {
+  (void)nthreads;
+  const scale_work* w = arg;
+  sweep_work sw = { w->buf + tid * w->per_thread, w->per_thread, w->chunk, 1, 0 };
+  sweep_thread(&sw, 0, 1);
+}
+
+// Large messages through the streaming API, as when hashing files.
+static void scale_stream(void* arg, int tid, int nthreads) {
+  (void)nthreads;
+  const scale_work* w = arg;
+  const unsigned char* p = w->buf + tid * w->per_thread;
+  unsigned char digest[32];
+
+  for (uint64_t off = 0; off < w->per_thread; off += SCALE_FILE) {
+    uint64_t len = w->per_thread - off < SCALE_FILE ? w->per_thread - off : SCALE_FILE;
+    sha256_ctx ctx;
+    sha256_init(&ctx);
+    for (uint64_t k = 0; k < len; k += STREAM_PIECE) {
+      sha256_update(&ctx, p + off + k, len - k < STREAM_PIECE ? len - k : STREAM_PIECE);
+    }
+    sha256_final(&ctx, digest);
+  }
+  sink ^= digest[0];
+}
+
+// Producers submitting messages to the shared queue, a window at a time.
+static void scale_queue(void* arg, int tid, int nthreads) {
+  (void)nthreads;
+  const scale_work* w = arg;
+  const unsigned char* p = w->buf + tid * w->per_thread;
+  sha256_job jobs[SCALE_WINDOW];
+
+  for (uint64_t off = 0; off < w->per_thread;) {
+    int n = 0;
+    for (; n < SCALE_WINDOW && off < w->per_thread; n++, off += w->chunk) {
+      uint64_t len = w->per_thread - off < w->chunk ? w->per_thread - off : w->chunk;
+      sha256_job_init(&jobs[n], p + off, len);
+      while (sha256_queue_submit(w->q, &jobs[n]) != 0) {
+        sched_yield();
+      }
+    }
+    for (int i = 0; i < n; i++) {
+      sha256_job_wait(&jobs[i]);
+    }
+  }
+  sink ^= jobs[0].digest[0];
+}
+
+static const scale_workload scale_workloads[] = {
+  { "batch", scale_batch },
+  { "stream", scale_stream },
+  { "queue", scale_queue },
+};
+
+static int cpu_core(int cpu) {
+  char path[128];
+  int core = cpu, pkg = 0;
+  snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_id", cpu);
+  FILE* f = fopen(path, "r");
+  if (f != NULL) {
+    if (fscanf(f, "%d", &core) != 1) {
+      core = cpu;
+    }
+    fclose(f);
+  }
+  snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+  f = fopen(path, "r");
+  if (f != NULL) {
+    if (fscanf(f, "%d", &pkg) != 1) {
+      pkg = 0;
+    }
+    fclose(f);
+  }
+  return pkg << 16 | core;
+}
+
+/*
+ * CPU orders for the two SMT settings. With SMT off, one logical CPU per
+ * core. With SMT on, siblings are adjacent, so the second thread lands on
+ * the first thread's core and any contention for its execution units shows
+ * up straight away.
+ */
+static int smt_order(int smt, int* order) {
+  int core[CPU_SETSIZE], used[CPU_SETSIZE] = { 0 };
+  int n = 0;
+
+  for (int i = 0; i < ncpus; i++) {
+    core[i] = cpu_core(cpus[i]);
+  }
+  for (int i = 0; i < ncpus; i++) {
+    if (used[i]) {
+      continue;
+    }
+    order[n++] = cpus[i];
+    used[i] = 1;
+    for (int j = i + 1; j < ncpus; j++) {
+      if (!used[j] && core[j] == core[i]) {
+        if (smt) {
+          order[n++] = cpus[j];
+        }
+        used[j] = 1;
+      }
+    }
+  }
+  return n;
+}
+
+static void mode_scaling(bench_opts* o) {
+  int order[2][CPU_SETSIZE];
+  int norder[2] = { smt_order(0, order[0]), smt_order(1, order[1]) };
+  int smt_modes = norder[1] > norder[0] ? 2 : 1;
+  uint64_t unit = o->max_size ? o->max_size : SCALE_WORK;
+
+  // Weak scaling needs unit bytes per thread.
+  scale_work w = { 0 };
+  w.chunk = o->chunk;
+  w.buf = malloc(unit * ncpus);
+  if (w.buf == NULL) {
+    perror("malloc");
+    return;
+  }
+  for (uint64_t i = 0; i < unit * ncpus; i++) {
+    w.buf[i] = (unsigned char)(i * 2654435761u >> 24);
+  }
+
+  printf("%d CPUs, %d cores; %llu MiB of work, %llu-byte messages, kernel %s\n", ncpus,
+         norder[0], (unsigned long long)unit >> 20, (unsigned long long)w.chunk,
+         sha256_kernel_name(sha256_get_kernel()));
+
+  for (unsigned wl = 0; wl < sizeof(scale_workloads) / sizeof(scale_workloads[0]); wl++) {
+    const scale_workload* sw = &scale_workloads[wl];
+    if (o->api != NULL && strcmp(o->api, sw->name) != 0) {
+      continue;
+    }
+    for (int smt = 0; smt < smt_modes; smt++) {
+      for (int weak = 0; weak < 2; weak++) {
+        printf("\n%s, SMT %s, %s scaling\n", sw->name, smt ? "on" : "off",
+               weak ? "weak" : "strong");
+        printf("%7s %10s %8s %10s %8s %10s  %s\n", "threads", "ms", "+-95%", "GB/s", "speedup",
+               "efficiency", "note");
+
+        double base_ns = 0;
+        // 1, 2, 4, ... threads, and always all of them.
+        for (int n = 1; n <= norder[smt]; n = 2 * n > norder[smt] && n < norder[smt] ?
+                                              norder[smt] : 2 * n) {
+          double ns[MAX_TRIALS];
+          w.per_thread = weak ? unit : unit / n;
+          w.per_thread -= w.per_thread % 64;
+          if (sw->fn == scale_queue) {
+            w.q = sha256_queue_create(4096, n, 16, 20);
+          }
+          run_parallel(n, order[smt], sw->fn, &w);     // warm-up
+          for (int t = 0; t < o->trials; t++) {
+            ns[t] = run_parallel(n, order[smt], sw->fn, &w);
+          }
+          if (w.q != NULL) {
+            sha256_queue_destroy(w.q);
+            w.q = NULL;
+          }
+
+          bench_stat st = summarize(ns, o->trials);
+          if (n == 1) {
+            base_ns = st.mean;
+          }
+          double bytes = (double)w.per_thread * n;
+          double speedup = weak ? base_ns * n / st.mean : base_ns / st.mean;
+          double eff = speedup / n;
+
+          // Name the likely cause once efficiency drops below 80%.
+          const char* note = "";
+          if (eff < 0.8) {
+            sweep_work rd = { w.buf, (uint64_t)bytes, w.chunk, 1, 1 };
+            double rd_gbs = bytes / run_parallel(n, order[smt], sweep_thread, &rd);
+            if (bytes / st.mean > 0.7 * rd_gbs) {
+              note = "memory bandwidth";
+            } else if (smt && n > 1) {
+              note = "SMT siblings share the SHA/vector units";
+            } else if (sw->fn == scale_queue) {
+              note = "queue contention";
+            } else {
+              note = "scaling breaks down";
+            }
+          }
+
+          printf("%7d %10.2f %8.2f %10.3f %8.2f %9.0f%%  %s\n", n, st.mean / 1e6, st.ci95 / 1e6,
+                 bytes / st.mean, speedup, 100 * eff, note);
+          fflush(stdout);
+
+          FILE* j = json_next(o);
+          if (j != NULL) {
+            fprintf(j, "{\"mode\": \"scaling\", \"workload\": \"%s\", \"smt\": %d, "
+                    "\"scaling\": \"%s\", \"threads\": %d, \"ms\": %.3f, \"ms_ci95\": %.3f, "
+                    "\"gbps\": %.4f, \"efficiency\": %.4f, \"note\": \"%s\"}", sw->name, smt,
+                    weak ? "weak" : "strong", n, st.mean / 1e6, st.ci95 / 1e6, bytes / st.mean,
+                    eff, note);
+          }
+        }
+      }
+    }
+  }
+  free(w.buf);
+}
+
+/*
+ * Trace replay.
+ */
+#define REPLAY_MAX_BUCKETS 4096
+#define REPLAY_MAX_MSGS (1 << 20)
+
+typedef struct {
+  uint64_t lo, hi, count;
+} replay_bucket;
+
+typedef struct {
+  replay_bucket b[REPLAY_MAX_BUCKETS];
+  int n;
+  uint64_t total;
+} replay_dist;
+
+typedef struct {
+  const unsigned char** msgs;
+  uint64_t* lens;
+  unsigned char (*digests)[32];
+  unsigned char** outs;
+  uint64_t n;
+  uint64_t bytes;
+  uint64_t* groups;        // batch sizes for the recorded configuration
+  uint64_t ngroups;
+  uint64_t group;          // batch size, 0 for the recorded groups
+  int oneshot;
+} replay_set;
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t rng(void) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state;
+}
+
+static uint64_t replay_draw(const replay_dist* d) {
+  uint64_t r = rng() % d->total;
+  int i = 0;
+  while (r >= d->b[i].count) {
+    r -= d->b[i].count;
+    i++;
+  }
+  return d->b[i].lo + rng() % (d->b[i].hi - d->b[i].lo + 1);
+}
+
+// Load the message-length buckets (of api, or of every per-message API) and
+// the batch-size buckets from a histogram written by the library.
+static int replay_load(const char* path, const char* api, replay_dist* lens,
+                       replay_dist* calls) {
+  static const char* const per_msg[] = { "hash", "final", "batch", "column" };
+  char line[256], name[32];
+  unsigned long long lo, hi, count;
+  FILE* f = fopen(path, "r");
+
+  if (f == NULL) {
+    perror(path);
+    return -1;
+  }
+  while (fgets(line, sizeof(line), f) != NULL) {
+    if (line[0] == '#' || sscanf(line, "%31s %llu %llu %llu", name, &lo, &hi, &count) != 4) {
+      continue;
+    }
+    replay_dist* d = NULL;
+    if (strcmp(name, "batch_call") == 0) {
+      d = calls;
+    } else if (api != NULL) {
+      d = strcmp(name, api) == 0 ? lens : NULL;
+    } else {
+      for (unsigned i = 0; i < sizeof(per_msg) / sizeof(per_msg[0]); i++) {
+        if (strcmp(name, per_msg[i]) == 0) {
+          d = lens;
+        }
+      }
+    }
+    if (d != NULL && d->n < REPLAY_MAX_BUCKETS && count > 0 && hi >= lo) {
+      d->b[d->n++] = (replay_bucket){ lo, hi, count };
+      d->total += count;
+    }
+  }
+  fclose(f);
+  return 0;
+}
+
+static void replay_run(replay_set* rs) {
+  if (rs->oneshot) {
+    for (uint64_t i = 0; i < rs->n; i++) {
+      sha256_hash(rs->msgs[i], rs->lens[i], rs->digests[i]);
+    }
+  } else if (rs->group > 0) {
+    for (uint64_t i = 0; i < rs->n; i += rs->group) {
+      uint64_t n = rs->n - i < rs->group ? rs->n - i : rs->group;
+      sha256_hash_batch(rs->msgs + i, rs->lens + i, n, rs->outs + i);
+    }
+  } else {
+    uint64_t i = 0;
+    for (uint64_t g = 0; i < rs->n; g = (g + 1) % rs->ngroups) {
+      uint64_t n = rs->n - i < rs->groups[g] ? rs->n - i : rs->groups[g];
+      sha256_hash_batch(rs->msgs + i, rs->lens + i, n, rs->outs + i);
+      i += n;
+    }
+  }
+  sink ^= rs->digests[rs->n - 1][0];
+}
+
+static void mode_replay(bench_opts* o) {
+  static replay_dist lens, calls;
+  uint64_t budget = o->max_size ? o->max_size : 64ULL << 20;
+
+  if (o->replay == NULL) {
+    fprintf(stderr, "replay needs a histogram file (-R)\n");
+    return;
+  }
+  if (replay_load(o->replay, o->api, &lens, &calls) != 0) {
+    return;
+  }
+  if (lens.total == 0) {
+    fprintf(stderr, "%s: no message lengths recorded\n", o->replay);
+    return;
+  }
+
+  // Draw messages until the byte budget or the message cap is reached.
+  replay_set rs = { 0 };
+  rs.msgs = malloc(REPLAY_MAX_MSGS * sizeof(*rs.msgs));
+  rs.lens = malloc(REPLAY_MAX_MSGS * sizeof(*rs.lens));
+  uint64_t maxlen = 0;
+  while (rs.n < REPLAY_MAX_MSGS && (rs.bytes < budget || rs.n == 0)) {
+    uint64_t len = replay_draw(&lens);
+    rs.lens[rs.n++] = len;
+    rs.bytes += len;
+    maxlen = len > maxlen ? len : maxlen;
+  }
+
+  // Messages start at random offsets of one shared buffer.
+  uint64_t buflen = (budget > maxlen ? budget : maxlen) + 64;
+  unsigned char* buf = malloc(buflen);
+  rs.digests = malloc(rs.n * 32);
+  rs.outs = malloc(rs.n * sizeof(*rs.outs));
+  if (buf == NULL || rs.digests == NULL || rs.outs == NULL) {
+    perror("malloc");
+    return;
+  }
+  for (uint64_t i = 0; i < buflen; i++) {
+    buf[i] = (unsigned char)(i * 2654435761u >> 24);
+  }
+  for (uint64_t i = 0; i < rs.n; i++) {
+    rs.msgs[i] = buf + rng() % (buflen - rs.lens[i]);
+    rs.outs[i] = rs.digests[i];
+  }
+
+  if (calls.total > 0) {
+    rs.ngroups = 4096;
+    rs.groups = malloc(rs.ngroups * sizeof(uint64_t));
+    for (uint64_t g = 0; g < rs.ngroups; g++) {
+      rs.groups[g] = replay_draw(&calls);
+      rs.groups[g] = rs.groups[g] ? rs.groups[g] : 1;
+    }
+  }
+
+  printf("replaying %s: %llu messages, %.1f MiB, mean %.0f bytes, max %llu\n", o->replay,
+         (unsigned long long)rs.n, rs.bytes / 1048576.0, (double)rs.bytes / rs.n,
+         (unsigned long long)maxlen);
+  printf("%-8s %-10s %12s %10s %10s\n", "kernel", "config", "ns/msg", "+-95%", "GB/s");
+
+  static const struct {
+    const char* name;
+    int oneshot;
+    uint64_t group;
+  } configs[] = {
+    { "oneshot", 1, 0 }, { "batch8", 0, 8 }, { "batch16", 0, 16 }, { "batch64", 0, 64 },
+    { "batch_all", 0, UINT64_MAX }, { "recorded", 0, 0 },
+  };
+
+  for (int k = SHA256_KERNEL_SCALAR; k < SHA256_NKERNELS; k++) {
+    const char* kname = sha256_kernel_name(k);
+    if (!sha256_kernel_supported(k) || (o->kernel != NULL && strcmp(o->kernel, kname) != 0)) {
+      continue;
+    }
+    sha256_set_kernel(k);
+
+    for (unsigned c = 0; c < sizeof(configs) / sizeof(configs[0]); c++) {
+      if ((configs[c].oneshot && k == SHA256_KERNEL_AVX2_X8) ||
+          (configs[c].group == 0 && !configs[c].oneshot && rs.groups == NULL)) {
+        continue;
+      }
+      rs.oneshot = configs[c].oneshot;
+      rs.group = configs[c].group;
+
+      double ns[MAX_TRIALS];
+      replay_run(&rs);
+      for (int t = 0; t < o->trials; t++) {
+        uint64_t passes = 0, t0 = now_ns(), t1;
+        do {
+          replay_run(&rs);
+          passes++;
+          t1 = now_ns();
+        } while (t1 - t0 < o->min_trial_ns);
+        ns[t] = (double)(t1 - t0) / passes / rs.n;
+      }
+      bench_stat st = summarize(ns, o->trials);
+      printf("%-8s %-10s %12.1f %10.1f %10.3f\n", kname, configs[c].name, st.mean, st.ci95,
+             rs.bytes / (st.mean * rs.n));
+      fflush(stdout);
+
+      FILE* j = json_next(o);
+      if (j != NULL) {
+        fprintf(j, "{\"mode\": \"replay\", \"kernel\": \"%s\", \"config\": \"%s\", "
+                "\"messages\": %llu, \"bytes\": %llu, \"ns_per_msg\": %.3f, "
+                "\"ns_per_msg_ci95\": %.3f}", kname, configs[c].name,
+                (unsigned long long)rs.n, (unsigned long long)rs.bytes, st.mean, st.ci95);
+      }
+    }
+  }
+  sha256_set_kernel(SHA256_KERNEL_AUTO);
+
+  free(rs.groups);
+  free(rs.outs);
+  free(rs.digests);
+  free(buf);
+  free(rs.lens);
+  free(rs.msgs);
+}
+
+/*
+ * Hardware counters.
+ */
+
+#define COUNTER_GROUPS 2
+
+typedef struct {
+  const char* name;
+  int group;                  // events of one group are scheduled together
+  uint32_t type;
+  uint64_t config;
+} counter_event;
+
+#define HW_CACHE(cache, op, result) \
+  ((cache) | (PERF_COUNT_HW_CACHE_OP_##op << 8) | (PERF_COUNT_HW_CACHE_RESULT_##result << 16))
+
+// The first event of each group leads it; uops and front-end stalls have no
+// portable encoding and are filled in per vendor by counter_events_init().
+static counter_event counter_events[] = {
+  { "cycles", 0, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+  { "instructions", 0, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+  { "branch-misses", 0, PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+  { "l1d-misses", 0, PERF_TYPE_HW_CACHE, HW_CACHE(PERF_COUNT_HW_CACHE_L1D, READ, MISS) },
+  { "cycles", 1, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+  { "uops", 1, PERF_TYPE_RAW, 0 },
+  { "fe-stalls", 1, PERF_TYPE_HARDWARE, PERF_COUNT_HW_STALLED_CYCLES_FRONTEND },
+};
+
+enum { EV_CYCLES, EV_INSTR, EV_BRMISS, EV_L1DMISS, EV_CYCLES1, EV_UOPS, EV_FESTALL, EV_COUNT };
+
+static void counter_events_init(void) {
+  unsigned int a, b, c, d;
+  char vendor[13] = { 0 };
+  __cpuid(0, a, b, c, d);
+  memcpy(vendor, &b, 4);
+  memcpy(vendor + 4, &d, 4);
+  memcpy(vendor + 8, &c, 4);
+
+  if (strcmp(vendor, "GenuineIntel") == 0) {
+    counter_events[EV_UOPS].config = 0x010e;                // UOPS_ISSUED.ANY
+    // IDQ_UOPS_NOT_DELIVERED.CYCLES_0_UOPS_DELIV.CORE: cycles the front
+    // end delivered nothing; the generic stall event is not mapped on Intel.
+    counter_events[EV_FESTALL].type = PERF_TYPE_RAW;
+    counter_events[EV_FESTALL].config = 0x0400019c;
+  } else if (strcmp(vendor, "AuthenticAMD") == 0) {
+    counter_events[EV_UOPS].config = 0x00c1;                // retired ops
+  } else {
+    counter_events[EV_UOPS].type = PERF_TYPE_MAX;           // never opens
+  }
+}
+
+static int perf_open(const counter_event* e, int leader) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = e->type;
+  attr.config = e->config;
+  attr.disabled = leader < 0;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                     PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+}
+
+/*
+ * Run iters calls of one case under each counter group in turn and store
+ * the count of every event per call in val (NAN where the event could not
+ * be opened or was never scheduled). Returns how many events counted.
+ */
+static int count_case(const bench_api* api, bench_case* bc, uint64_t iters, double* val) {
+  int counted = 0;
+
+  for (int e = 0; e < EV_COUNT; e++) {
+    val[e] = NAN;
+  }
+  for (int g = 0; g < COUNTER_GROUPS; g++) {
+    int fd[EV_COUNT], ev[EV_COUNT], n = 0;
+    for (int e = 0; e < EV_COUNT; e++) {
+      if (counter_events[e].group == g) {
+        fd[n] = perf_open(&counter_events[e], n ? fd[0] : -1);
+        if (fd[n] >= 0) {
+          ev[n++] = e;
+        } else if (n == 0) {
+          break;              // no leader, no group
+        }
+      }
+    }
+    if (n == 0) {
+      continue;
+    }
+
+    api->run(bc);
+    ioctl(fd[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    for (uint64_t i = 0; i < iters; i++) {
+      api->run(bc);
+    }
+    ioctl(fd[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+    uint64_t buf[3 + EV_COUNT];
+    if (read(fd[0], buf, sizeof(buf)) >= (ssize_t)(3 + n) * 8 && buf[0] == (uint64_t)n &&
+        buf[2] > 0) {
+      // Scale up if the group was multiplexed with other users.
+      double scale = (double)buf[1] / buf[2];
+      for (int i = 0; i < n; i++) {
+        val[ev[i]] = buf[3 + i] * scale / iters;
+        counted++;
+      }
+    }
+    for (int i = 0; i < n; i++) {
+      close(fd[i]);
+    }
+  }
+  return counted;
+}
+
+// SHA-256 blocks compressed by one call of api at the case's size.
+static double case_blocks(const bench_api* api, const bench_case* bc) {
+  if (api->run == run_compress) {
+    return (double)(bc->size / 64);
+  }
+  return (double)((bc->size + 9 + 63) / 64 * api->hashes);
+}
+
+static void print_per_block(double v, double blocks) {
+  if (isnan(v)) {
+    printf(" %10s", "-");
+  } else {
+    printf(" %10.1f", v / blocks);
+  }
+}
+
+static void json_per_block(FILE* j, const char* key, double v, double blocks) {
+  if (isnan(v)) {
+    fprintf(j, ", \"%s\": null", key);
+  } else {
+    fprintf(j, ", \"%s\": %.3f", key, v / blocks);
+  }
+}
+
+static void mode_counters(bench_opts* o) {
+  bench_case bcase = { 0 };
+  bench_case* bc = &bcase;
+  uint64_t min_size = o->min_size > 64 ? o->min_size : 64;
+
+  if (o->max_size == 0) {
+    o->max_size = 1ULL << 20;
+  }
+  counter_events_init();
+
+  // Bail out early if the PMU is out of reach (VMs, containers,
+  // perf_event_paranoid > 2, ...) rather than print a table of dashes.
+  int probe = perf_open(&counter_events[EV_CYCLES], -1);
+  if (probe < 0) {
+    perror("perf_event_open(cycles)");
+    fprintf(stderr, "hardware counters unavailable; check /proc/sys/kernel/perf_event_paranoid\n");
+    return;
+  }
+  close(probe);
+
+  if (case_alloc(bc, BATCH * o->max_size) != 0) {
+    return;
+  }
+
+  printf("%-8s %-9s %10s %10s %10s %10s %10s %10s %10s %10s\n", "kernel", "api", "size",
+         "cyc/blk", "ins/blk", "IPC", "uops/blk", "brmiss/blk", "L1Dmis/blk", "fe-stall%");
+
+  for (int k = SHA256_KERNEL_SCALAR; k < SHA256_NKERNELS; k++) {
+    const char* kname = sha256_kernel_name(k);
+    if (!sha256_kernel_supported(k) || (o->kernel != NULL && strcmp(o->kernel, kname) != 0)) {
+      continue;
+    }
+    sha256_set_kernel(k);
+
+    for (unsigned a = 0; a < sizeof(apis) / sizeof(apis[0]); a++) {
+      const bench_api* api = &apis[a];
+      if ((k == SHA256_KERNEL_AVX2_X8 && !api->any_kernel) ||
+          (o->api != NULL && strcmp(o->api, api->name) != 0)) {
+        continue;
+      }
+
+      for (uint64_t size = min_size; size <= o->max_size; size *= 4) {
+        case_size(bc, size);
+
+        api->run(bc);
+        uint64_t t0 = now_ns();
+        api->run(bc);
+        uint64_t one = now_ns() - t0 + 1;
+        uint64_t iters = o->min_trial_ns > one ? (uint64_t)(o->min_trial_ns / one) : 1;
+
+        double v[EV_COUNT];
+        if (count_case(api, bc, iters, v) == 0) {
+          continue;
+        }
+        double blocks = case_blocks(api, bc);
+        double ipc = v[EV_INSTR] / v[EV_CYCLES];
+        double fe = 100 * v[EV_FESTALL] / v[EV_CYCLES1];
+
+        printf("%-8s %-9s %10llu", kname, api->name, (unsigned long long)size);
+        print_per_block(v[EV_CYCLES], blocks);
+        print_per_block(v[EV_INSTR], blocks);
+        print_per_block(ipc, 1);
+        print_per_block(v[EV_UOPS], blocks);
+        print_per_block(v[EV_BRMISS], blocks);
+        print_per_block(v[EV_L1DMISS], blocks);
+        print_per_block(fe, 1);
+        printf("\n");
+        fflush(stdout);
+
+        FILE* j = json_next(o);
+        if (j != NULL) {
+          fprintf(j, "{\"mode\": \"counters\", \"kernel\": \"%s\", \"api\": \"%s\", "
+                  "\"size\": %llu, \"blocks_per_call\": %.0f", kname, api->name,
+                  (unsigned long long)size, blocks);
+          json_per_block(j, "cycles_per_block", v[EV_CYCLES], blocks);
+          json_per_block(j, "instructions_per_block", v[EV_INSTR], blocks);
+          json_per_block(j, "ipc", ipc, 1);
+          json_per_block(j, "uops_per_block", v[EV_UOPS], blocks);
+          json_per_block(j, "branch_misses_per_block", v[EV_BRMISS], blocks);
+          json_per_block(j, "l1d_misses_per_block", v[EV_L1DMISS], blocks);
+          json_per_block(j, "frontend_stall_pct", fe, 1);
+          fprintf(j, "}");
+        }
+      }
+    }
+  }
+  sha256_set_kernel(SHA256_KERNEL_AUTO);
+  free(bc->buf);
+}
+
+/*
+ * Energy.
+ */
+
+#define RAPL_MAX_ZONES 16
+#define ENERGY_MIN_NS 250e6
+
+typedef struct {
+  char path[160];          // energy_uj
+  char name[32];
+  uint64_t range;          // max_energy_range_uj, where energy_uj wraps
+} rapl_zone;
+
+static rapl_zone rapl_zones[RAPL_MAX_ZONES];
+static int rapl_nzones;
+
+static int read_u64(const char* path, uint64_t* v) {
+  FILE* f = fopen(path, "r");
+  if (f == NULL) {
+    return -1;
+  }
+  int ok = fscanf(f, "%" SCNu64, v) == 1;
+  fclose(f);
+  return ok ? 0 : -1;
+}
+
+/*
+ * Find the package and DRAM zones of the RAPL powercap driver. It serves
+ * AMD as well as Intel under the intel-rapl name. Core and uncore zones are
+ * part of their package, and psys overlaps everything, so they are skipped.
+ */
+static void rapl_init(void) {
+  glob_t g;
+  rapl_nzones = 0;
+  if (glob("/sys/class/powercap/intel-rapl:*", 0, NULL, &g) != 0) {
+    return;
+  }
+  for (size_t i = 0; i < g.gl_pathc && rapl_nzones < RAPL_MAX_ZONES; i++) {
+    rapl_zone* z = &rapl_zones[rapl_nzones];
+    char path[160];
+    uint64_t v;
+
+    snprintf(path, sizeof(path), "%s/name", g.gl_pathv[i]);
+    FILE* f = fopen(path, "r");
+    if (f == NULL || fgets(z->name, sizeof(z->name), f) == NULL) {
+      if (f != NULL) {
+        fclose(f);
+      }
+      continue;
+    }
+    fclose(f);
+    z->name[strcspn(z->name, "\n")] = 0;
+    if (strncmp(z->name, "package", 7) != 0 && strcmp(z->name, "dram") != 0) {
+      continue;
+    }
+
+    snprintf(z->path, sizeof(z->path), "%s/energy_uj", g.gl_pathv[i]);
+    snprintf(path, sizeof(path), "%s/max_energy_range_uj", g.gl_pathv[i]);
+    if (read_u64(z->path, &v) == 0 && read_u64(path, &z->range) == 0) {
+      rapl_nzones++;
+    }
+  }
+  globfree(&g);
+}
+
+static void rapl_read(uint64_t* uj) {
+  for (int i = 0; i < rapl_nzones; i++) {
+    if (read_u64(rapl_zones[i].path, &uj[i]) != 0) {
+      uj[i] = 0;
+    }
+  }
+}
+
+// Joules used since before, across all zones.
+static double rapl_joules(const uint64_t* before) {
+  uint64_t after[RAPL_MAX_ZONES];
+  double j = 0;
+  rapl_read(after);
+  for (int i = 0; i < rapl_nzones; i++) {
+    uint64_t d = after[i] >= before[i] ? after[i] - before[i]
+                                       : rapl_zones[i].range - before[i] + after[i];
+    j += d / 1e6;
+  }
+  return j;
+}
+
+static void mode_energy(bench_opts* o) {
+  int order[CPU_SETSIZE];
+  int norder = smt_order(1, order);
+  uint64_t unit = o->max_size ? o->max_size : SCALE_WORK;
+
+  rapl_init();
+  if (rapl_nzones == 0) {
+    fprintf(stderr, "RAPL energy counters unavailable (no readable intel-rapl zone in "
+            "/sys/class/powercap; energy_uj is root-only on recent kernels); "
+            "reporting throughput only\n");
+  }
+
+  scale_work w = { 0 };
+  w.chunk = o->chunk;
+  w.buf = malloc(unit * ncpus);
+  if (w.buf == NULL) {
+    perror("malloc");
+    return;
+  }
+  for (uint64_t i = 0; i < unit * ncpus; i++) {
+    w.buf[i] = (unsigned char)(i * 2654435761u >> 24);
+  }
+  w.per_thread = unit - unit % 64;
+
+  // Idle power, for judging how much of each figure is the baseline.
+  if (rapl_nzones > 0) {
+    uint64_t e0[RAPL_MAX_ZONES];
+    rapl_read(e0);
+    uint64_t t0 = now_ns();
+    struct timespec ts = { 0, 500000000 };
+    nanosleep(&ts, NULL);
+    double idle_w = rapl_joules(e0) / ((now_ns() - t0) / 1e9);
+    printf("RAPL zones:");
+    for (int i = 0; i < rapl_nzones; i++) {
+      printf(" %s", rapl_zones[i].name);
+    }
+    printf("; idle %.1f W\n", idle_w);
+  }
+  printf("%llu MiB per thread in %llu-byte messages through sha256_hash_batch()\n",
+         (unsigned long long)unit >> 20, (unsigned long long)w.chunk);
+  printf("%-8s %7s %10s %10s %10s %8s %14s\n", "kernel", "threads", "GB/s", "W", "J/GiB",
+         "+-95%", "hashes/J");
+
+  for (int k = SHA256_KERNEL_SCALAR; k < SHA256_NKERNELS; k++) {
+    const char* kname = sha256_kernel_name(k);
+    if (!sha256_kernel_supported(k) || (o->kernel != NULL && strcmp(o->kernel, kname) != 0)) {
+      continue;
+    }
+    sha256_set_kernel(k);
+
+    for (int n = 1; n <= norder; n = 2 * n > norder && n < norder ? norder : 2 * n) {
+      double jpg[MAX_TRIALS], watts = 0, gbps = 0;
+
+      run_parallel(n, order, scale_batch, &w);     // warm-up
+      for (int t = 0; t < o->trials; t++) {
+        uint64_t e0[RAPL_MAX_ZONES];
+        double ns = 0, bytes = 0;
+        rapl_read(e0);
+        // RAPL updates about every millisecond; run long enough to swamp that.
+        while (ns < ENERGY_MIN_NS) {
+          ns += run_parallel(n, order, scale_batch, &w);
+          bytes += (double)w.per_thread * n;
+        }
+        double joules = rapl_joules(e0);
+        jpg[t] = joules / (bytes / (1ULL << 30));
+        watts += joules / (ns / 1e9) / o->trials;
+        gbps += bytes / ns / o->trials;
+      }
+
+      double hashes_per_gib = (double)(1ULL << 30) / w.chunk;
+      bench_stat st = summarize(jpg, o->trials);
+      if (rapl_nzones > 0) {
+        printf("%-8s %7d %10.3f %10.1f %10.2f %8.2f %14.0f\n", kname, n, gbps, watts, st.mean,
+               st.ci95, hashes_per_gib / st.mean);
+      } else {
+        printf("%-8s %7d %10.3f %10s %10s %8s %14s\n", kname, n, gbps, "-", "-", "-", "-");
+      }
+      fflush(stdout);
+
+      FILE* j = json_next(o);
+      if (j != NULL) {
+        fprintf(j, "{\"mode\": \"energy\", \"kernel\": \"%s\", \"threads\": %d, "
+                "\"chunk\": %llu, \"gbps\": %.4f", kname, n, (unsigned long long)w.chunk, gbps);
+        if (rapl_nzones > 0) {
+          fprintf(j, ", \"watts\": %.3f, \"joules_per_gib\": %.4f, \"joules_per_gib_ci95\": %.4f, "
+                  "\"hashes_per_joule\": %.1f}", watts, st.mean, st.ci95,
+                  hashes_per_gib / st.mean);
+        } else {
+          fprintf(j, ", \"watts\": null, \"joules_per_gib\": null, "
+                  "\"joules_per_gib_ci95\": null, \"hashes_per_joule\": null}");
+        }
+      }
+    }
+  }
+  sha256_set_kernel(SHA256_KERNEL_AUTO);
+  free(w.buf);
+}
+
+static const struct {
+  const char* name;
+  void (*run)(bench_opts* o);
+} modes[] = {
+  { "sizes", mode_sizes },
+  { "sweep", mode_sweep },
+  { "scaling", mode_scaling },
+  { "replay", mode_replay },
+  { "counters", mode_counters },
+  { "energy", mode_energy },
+};
+
+// A byte count with an optional K, M or G (binary) suffix.
+static uint64_t parse_size(const char* arg) {
+  char* end;
+  uint64_t v = strtoull(arg, &end, 0);
+  switch (*end) {
+    case 'K': case 'k': return v << 10;
+    case 'M': case 'm': return v << 20;
+    case 'G': case 'g': return v << 30;
+  }
+  return v;
+}
+
+static void usage(const char* prog) {
+  fprintf(stderr, "usage: %s [-m mode] [-s min] [-M max] [-k kernel] [-a api] [-r trials] "
+          "[-T ms] [-c cpu] [-C chunk] [-R hist] [-j out.json]\n", prog);
+}
+
+int main(int argc, char** argv) {
+  bench_opts o = { 0, 0, NULL, NULL, 7, 20e6, -1, 4096, NULL, NULL, 1 };
+  const char* json_path = NULL;
+  const char* mode = "sizes";
+  int opt;
+
+  while ((opt = getopt(argc, argv, "m:s:M:k:a:r:T:c:C:R:j:h")) != -1) {
+    switch (opt) {
+      case 'm': mode = optarg; break;
+      case 'R': o.replay = optarg; break;
+      case 'C': o.chunk = parse_size(optarg); break;
+      case 's': o.min_size = parse_size(optarg); break;
+      case 'M': o.max_size = parse_size(optarg); break;
+      case 'k': o.kernel = optarg; break;
+      case 'a': o.api = optarg; break;
+      case 'r': o.trials = atoi(optarg); break;
+      case 'T': o.min_trial_ns = atof(optarg) * 1e6; break;
+      case 'c': o.cpu = atoi(optarg); break;
+      case 'j': json_path = optarg; break;
+      default: usage(argv[0]); return 2;
+    }
+  }
+  if (o.trials < 2) {
+    o.trials = 2;
+  } else if (o.trials > MAX_TRIALS) {
+    o.trials = MAX_TRIALS;
+  }
+
+  if (o.chunk < 64) {
+    o.chunk = 64;
+  }
+
+  unsigned m = 0;
+  while (m < sizeof(modes) / sizeof(modes[0]) && strcmp(modes[m].name, mode) != 0) {
+    m++;
+  }
+  if (m == sizeof(modes) / sizeof(modes[0])) {
+    usage(argv[0]);
+    return 2;
+  }
+  if (o.kernel != NULL) {
+    int k = SHA256_KERNEL_AUTO;
+    while (k < SHA256_NKERNELS && strcmp(sha256_kernel_name(k), o.kernel) != 0) {
+      k++;
+    }
+    if (k == SHA256_NKERNELS || sha256_set_kernel(k) != 0) {
+      fprintf(stderr, "kernel %s is not available\n", o.kernel);
+      return 1;
+    }
+  }
+
+  list_cpus();
+  pin_cpu(o.cpu >= 0 ? o.cpu : sched_getcpu());
+  tsc_ghz = calibrate_tsc();
+
+  char model[128];
+  cpu_model(model, sizeof(model));
+  printf("cpu: %s, TSC %.3f GHz, %d trials of >= %.0f ms\n", model, tsc_ghz, o.trials,
+         o.min_trial_ns / 1e6);
+
+  if (json_path != NULL) {
+    o.json = fopen(json_path, "w");
+    if (o.json == NULL) {
+      perror(json_path);
+      return 1;
+    }
+    time_t now = time(NULL);
+    fprintf(o.json, "{\n  \"cpu\": \"%s\",\n  \"tsc_ghz\": %.4f,\n  \"timestamp\": %lld,\n"
+            "  \"results\": [", model, tsc_ghz, (long long)now);
+  }
+
+  modes[m].run(&o);
+
+  if (o.json != NULL) {
+    fprintf(o.json, "\n  ]\n}\n");
+    fclose(o.json);
+  }
+  return 0;
+}
@@ -1,10 +1,24 @@
 /**
  * sha256.c - Implementation of SHA-256 algorithm.
  */
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SHA256_HAVE_AVX2 1
+#include <immintrin.h>
+#include <cpuid.h>
+#endif
+
+#include "sha256.h"
+#include "sha256_inline.h"
+#include "sha256_probes.h"
 
 #define WORD_MASK 0xFFFFFFFFU
 
@@ -61,7 +75,9 @@ unsigned char* padmsg(unsigned char* M, uint64_t* len, uint64_t* newbitlen) {
     k += 512;
   }
 
+#ifdef SHA256_TRACE
   printf("K: %d\n", k);
+#endif
 
   // convert length to 64 bit val.
   unsigned char lenbytes[8];
@@ -120,10 +136,24 @@ uint32_t H0[] = {
   0x5be0cd19
 };
 
+// SHA-224 initial hash values.
+uint32_t H0_224[] = {
+  0xc1059ed8,
+  0x367cd507,
+  0x3070dd17,
+  0xf70e5939,
+  0xffc00b31,
+  0x68581511,
+  0x64f98fa7,
+  0xbefa4fa4
+};
+
 void printwords(uint32_t*, int);
 
 uint32_t* sha256_compute(unsigned char** msgblks, uint64_t* numblks) {
-  uint32_t* H = H0;
+  // Work on a copy so H0 stays intact for the next message.
+  static uint32_t H[8];
+  memcpy(H, H0, sizeof(H));
   uint32_t M[16];
   uint32_t W[64];  // TODO: OpenSSL can do SHA with length 16 message schedule. Implement that.
   uint32_t a, b, c, d, e, f, g, h, T1, T2;
@@ -148,9 +178,11 @@ uint32_t* sha256_compute(unsigned char** msgblks, uint64_t* numblks) {
       }
     }
 
+#ifdef SHA256_TRACE
     printf("W[0-16]: ");
     printwords(W, 16);
     printf("\n");
+#endif
 
     // Init working vars.
     a = H[0];
@@ -174,6 +206,7 @@ uint32_t* sha256_compute(unsigned char** msgblks, uint64_t* numblks) {
       b = a;
       a = T1 + T2;
 
+#ifdef SHA256_TRACE
       printf("t=%02d ", t);
       printf("%04X ", a);
       printf("%04X ", b);
@@ -184,6 +217,7 @@ uint32_t* sha256_compute(unsigned char** msgblks, uint64_t* numblks) {
       printf("%04X ", g);
       printf("%04X ", h);
       printf("\n\n");
+#endif
     }
 
     H[0] = a + H[0];
@@ -207,6 +241,1411 @@ uint32_t* sha256(unsigned char* msg, uint64_t* msglen) {
   return digest;
 }
 
+/*
+ * Fast path.
+ *
+ * The functions above materialize the padded message and every block before
+ * hashing. The code below hashes whole blocks straight out of the caller's
+ * buffer and only builds the one or two padded final blocks on the stack.
+ * The portable and SHA-NI kernels and the tail padding live in
+ * sha256_inline.h so that header-only users inline the same code.
+ */
+
+#ifdef SHA256_HAVE_AVX2
+/*
+ * 8-lane AVX2 kernel.
+ *
+ * Runs eight independent messages through one block each. Lane l of every
+ * vector belongs to message l, and the state is kept transposed as
+ * S[word][lane] so a state word loads as a single vector.
+ */
+#define ROTR_X8(x, n) _mm256_or_si256(_mm256_srli_epi32((x), (n)), _mm256_slli_epi32((x), 32-(n)))
+#define SIGMA0_X8(x) _mm256_xor_si256(_mm256_xor_si256(ROTR_X8(x, 2), ROTR_X8(x, 13)), ROTR_X8(x, 22))
+#define SIGMA1_X8(x) _mm256_xor_si256(_mm256_xor_si256(ROTR_X8(x, 6), ROTR_X8(x, 11)), ROTR_X8(x, 25))
+#define sigma0_X8(x) _mm256_xor_si256(_mm256_xor_si256(ROTR_X8(x, 7), ROTR_X8(x, 18)), _mm256_srli_epi32((x), 3))
+#define sigma1_X8(x) _mm256_xor_si256(_mm256_xor_si256(ROTR_X8(x, 17), ROTR_X8(x, 19)), _mm256_srli_epi32((x), 10))
+
+__attribute__((target("avx2")))
+static void sha256_x8_avx2(uint32_t S[8][8], const unsigned char* const blk[8]) {
+  const __m256i bswap = _mm256_setr_epi8(
+      3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+      3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+  __m256i W[16];
+
+  // Load words 0-7, then 8-15, of every lane and transpose them so that
+  // W[t] holds word t of all eight blocks.
+  for (int half = 0; half < 2; half++) {
+    __m256i r[8], t[8], u[8];
+    for (int l = 0; l < 8; l++) {
+      r[l] = _mm256_loadu_si256((const __m256i*)(blk[l] + 32*half));
+    }
+    for (int l = 0; l < 8; l += 2) {
+      t[l]   = _mm256_unpacklo_epi32(r[l], r[l+1]);
+      t[l+1] = _mm256_unpackhi_epi32(r[l], r[l+1]);
+    }
+    for (int l = 0; l < 8; l += 4) {
+      u[l]   = _mm256_unpacklo_epi64(t[l],   t[l+2]);
+      u[l+1] = _mm256_unpackhi_epi64(t[l],   t[l+2]);
+      u[l+2] = _mm256_unpacklo_epi64(t[l+1], t[l+3]);
+      u[l+3] = _mm256_unpackhi_epi64(t[l+1], t[l+3]);
+    }
+    for (int j = 0; j < 4; j++) {
+      W[8*half+j]   = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u[j], u[j+4], 0x20), bswap);
+      W[8*half+j+4] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u[j], u[j+4], 0x31), bswap);
+    }
+  }
+
+  __m256i a = _mm256_loadu_si256((const __m256i*)S[0]);
+  __m256i b = _mm256_loadu_si256((const __m256i*)S[1]);
+  __m256i c = _mm256_loadu_si256((const __m256i*)S[2]);
+  __m256i d = _mm256_loadu_si256((const __m256i*)S[3]);
+  __m256i e = _mm256_loadu_si256((const __m256i*)S[4]);
+  __m256i f = _mm256_loadu_si256((const __m256i*)S[5]);
+  __m256i g = _mm256_loadu_si256((const __m256i*)S[6]);
+  __m256i h = _mm256_loadu_si256((const __m256i*)S[7]);
+  __m256i T1, T2;
+
+  for (int t = 0; t < 64; t++) {
+    if (t >= 16) {
+      W[t&15] = _mm256_add_epi32(
+          _mm256_add_epi32(sigma1_X8(W[(t-2)&15]), W[(t-7)&15]),
+          _mm256_add_epi32(sigma0_X8(W[(t-15)&15]), W[t&15]));
+    }
+    T1 = _mm256_add_epi32(
+        _mm256_add_epi32(h, SIGMA1_X8(e)),
+        _mm256_add_epi32(
+            _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g)),
+            _mm256_add_epi32(_mm256_set1_epi32(sha256_K[t]), W[t&15])));
+    T2 = _mm256_add_epi32(
+        SIGMA0_X8(a),
+        _mm256_xor_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_xor_si256(a, b))));
+    h = g;
+    g = f;
+    f = e;
+    e = _mm256_add_epi32(d, T1);
+    d = c;
+    c = b;
+    b = a;
+    a = _mm256_add_epi32(T1, T2);
+  }
+
+  _mm256_storeu_si256((__m256i*)S[0], _mm256_add_epi32(a, _mm256_loadu_si256((const __m256i*)S[0])));
+  _mm256_storeu_si256((__m256i*)S[1], _mm256_add_epi32(b, _mm256_loadu_si256((const __m256i*)S[1])));
+  _mm256_storeu_si256((__m256i*)S[2], _mm256_add_epi32(c, _mm256_loadu_si256((const __m256i*)S[2])));
+  _mm256_storeu_si256((__m256i*)S[3], _mm256_add_epi32(d, _mm256_loadu_si256((const __m256i*)S[3])));
+  _mm256_storeu_si256((__m256i*)S[4], _mm256_add_epi32(e, _mm256_loadu_si256((const __m256i*)S[4])));
+  _mm256_storeu_si256((__m256i*)S[5], _mm256_add_epi32(f, _mm256_loadu_si256((const __m256i*)S[5])));
+  _mm256_storeu_si256((__m256i*)S[6], _mm256_add_epi32(g, _mm256_loadu_si256((const __m256i*)S[6])));
+  _mm256_storeu_si256((__m256i*)S[7], _mm256_add_epi32(h, _mm256_loadu_si256((const __m256i*)S[7])));
+}
+
+static int cpu_has_avx2(void) {
+  static int has = -1;
+  if (has < 0) {
+    __builtin_cpu_init();
+    has = __builtin_cpu_supports("avx2") ? 1 : 0;
+  }
+  return has;
+}
+#endif /* SHA256_HAVE_AVX2 */
+
+#ifdef SHA256_HAVE_AVX2
+static int cpu_has_shani(void) {
+  static int has = -1;
+  if (has < 0) {
+    unsigned int a, b, c, d;
+    has = 0;
+    if (__get_cpuid(1, &a, &b, &c, &d) && (c & bit_SSE4_1) &&
+        __get_cpuid_count(7, 0, &a, &b, &c, &d) && (b & bit_SHA)) {
+      has = 1;
+    }
+  }
+  return has;
+}
+#endif /* SHA256_HAVE_AVX2 */
+
+/*
+ * Kernel dispatch.
+ *
+ * The best kernel for the CPU is picked on first use: SHA-NI, then the
+ * portable one. The 8-lane AVX2 kernel only pays off with several
+ * independent messages, so it is used by the batch and columnar entry points
+ * when SHA-NI is missing. sha256_set_kernel() overrides the choice.
+ */
+typedef void (*sha256_blocks_fn)(uint32_t H[8], const unsigned char* blks, uint64_t nblks);
+
+static sha256_blocks_fn sha256_blocks_cur = NULL;
+static int sha256_x8_cur = 0;
+static sha256_kernel sha256_kernel_cur = SHA256_KERNEL_AUTO;
+
+// Message size classes: <=64, <=256, <=1K, <=4K, <=16K, <=64K, <=1M, >1M.
+#define SHA256_SIZE_CLASSES 8
+
+static inline int sha256_size_class(uint64_t len) {
+  if (len <= 64) {
+    return 0;
+  }
+  int c = (64 - __builtin_clzll(len - 1) - 5) / 2;
+  return c < 6 ? c : len > (1u << 20) ? 7 : 6;
+}
+
+// Autotuned choice per size class (sha256_autotune()), followed while the
+// kernel is AUTO. A table is filled privately, then published with one
+// release store; readers take it with an acquire load and never see it half
+// written. Tables are never freed, since a reader may still hold the last.
+typedef struct {
+  sha256_blocks_fn single[SHA256_SIZE_CLASSES];
+  int x8[SHA256_SIZE_CLASSES];
+} sha256_tune_table;
+
+static const sha256_tune_table* sha256_tune_last = NULL;   // latest result
+static const sha256_tune_table* sha256_tune_cur = NULL;    // followed, or NULL
+
+static void sha256_autotune_env(void);
+
+int sha256_kernel_supported(sha256_kernel k) {
+  switch (k) {
+    case SHA256_KERNEL_AUTO:
+    case SHA256_KERNEL_SCALAR:
+      return 1;
+#ifdef SHA256_HAVE_AVX2
+    case SHA256_KERNEL_SHANI:
+      return cpu_has_shani();
+    case SHA256_KERNEL_AVX2_X8:
+      return cpu_has_avx2();
+#endif
+    default:
+      return 0;
+  }
+}
+
+const char* sha256_kernel_name(sha256_kernel k) {
+  switch (k) {
+    case SHA256_KERNEL_AUTO: return "auto";
+    case SHA256_KERNEL_SCALAR: return "scalar";
+    case SHA256_KERNEL_SHANI: return "shani";
+    case SHA256_KERNEL_AVX2_X8: return "avx2x8";
+  }
+  return "unknown";
+}
+
+#if defined(SHA256_STATS) || defined(SHA256_PROBES)
+// The sha256_kernel value of a single-message kernel.
+static int sha256_kernel_of(sha256_blocks_fn fn) {
+#ifdef SHA256_HAVE_AVX2
+  if (fn == sha256_blocks_shani) {
+    return SHA256_KERNEL_SHANI;
+  }
+#endif
+  (void)fn;
+  return SHA256_KERNEL_SCALAR;
+}
+#endif
+
+// sha256_set_kernel() without the first-use setup.
+static int sha256_select_kernel(sha256_kernel k) {
+  if (!sha256_kernel_supported(k)) {
+    return -1;
+  }
+
+  sha256_blocks_fn fn = sha256_blocks_scalar;
+  int x8 = 0;
+#ifdef SHA256_HAVE_AVX2
+  if (cpu_has_shani() && k != SHA256_KERNEL_SCALAR) {
+    fn = sha256_blocks_shani;
+  }
+  x8 = k == SHA256_KERNEL_AVX2_X8 || (k == SHA256_KERNEL_AUTO && cpu_has_avx2() && !cpu_has_shani());
+#endif
+
+  // Streaming and the other callers without a message size get the kernel
+  // tuned for the largest messages.
+  const sha256_tune_table* tune = NULL;
+  if (k == SHA256_KERNEL_AUTO) {
+    tune = __atomic_load_n(&sha256_tune_last, __ATOMIC_ACQUIRE);
+  }
+  if (tune != NULL) {
+    fn = tune->single[SHA256_SIZE_CLASSES - 1];
+  }
+
+  __atomic_store_n(&sha256_x8_cur, x8, __ATOMIC_RELAXED);
+  __atomic_store_n(&sha256_kernel_cur, k, __ATOMIC_RELAXED);
+  __atomic_store_n(&sha256_tune_cur, tune, __ATOMIC_RELEASE);
+  __atomic_store_n(&sha256_blocks_cur, fn, __ATOMIC_RELEASE);
+  SHA256_PROBE3(kernel__select, (int)k, sha256_kernel_of(fn),
+                (tune != NULL ? tune->x8[SHA256_SIZE_CLASSES - 1] : x8) ? 8 : 1);
+  return 0;
+}
+
+static pthread_once_t sha256_dispatch_once = PTHREAD_ONCE_INIT;
+
+static void sha256_dispatch_init(void) {
+  sha256_select_kernel(SHA256_KERNEL_AUTO);
+  sha256_autotune_env();
+}
+
+// First use runs here too, so SHA256_AUTOTUNE is honoured when the caller
+// picks a kernel before hashing anything.
+int sha256_set_kernel(sha256_kernel k) {
+  pthread_once(&sha256_dispatch_once, sha256_dispatch_init);
+  return sha256_select_kernel(k);
+}
+
+sha256_kernel sha256_get_kernel(void) {
+  return __atomic_load_n(&sha256_kernel_cur, __ATOMIC_RELAXED);
+}
+
+static sha256_blocks_fn sha256_blocks_kernel(void) {
+  sha256_blocks_fn fn = __atomic_load_n(&sha256_blocks_cur, __ATOMIC_ACQUIRE);
+  if (__builtin_expect(fn == NULL, 0)) {
+    pthread_once(&sha256_dispatch_once, sha256_dispatch_init);
+    fn = __atomic_load_n(&sha256_blocks_cur, __ATOMIC_ACQUIRE);
+  }
+  return fn;
+}
+
+static inline const sha256_tune_table* sha256_tune_table_cur(void) {
+  return __atomic_load_n(&sha256_tune_cur, __ATOMIC_ACQUIRE);
+}
+
+// Use the 8-lane kernel for independent messages of about len bytes each?
+static int sha256_use_x8_len(uint64_t len) {
+  sha256_blocks_kernel();
+  const sha256_tune_table* tune = sha256_tune_table_cur();
+  return tune != NULL ? tune->x8[sha256_size_class(len)] : __atomic_load_n(&sha256_x8_cur, __ATOMIC_RELAXED);
+}
+
+// The kernel for one message of len bytes.
+static inline sha256_blocks_fn sha256_blocks_for(uint64_t len) {
+  sha256_blocks_fn fn = sha256_blocks_kernel();
+  const sha256_tune_table* tune = sha256_tune_table_cur();
+  return tune != NULL ? tune->single[sha256_size_class(len)] : fn;
+}
+
+static inline void sha256_blocks(uint32_t H[8], const unsigned char* blks, uint64_t nblks) {
+  sha256_blocks_kernel()(H, blks, nblks);
+}
+
+/*
+ * Size recording.
+ *
+ * Built with -DSHA256_RECORD, the public entry points count the lengths
+ * they are called with, per API, in log-linear buckets (exact below 16,
+ * then eight buckets per power of two). Recording starts on the first call
+ * when SHA256_RECORD=path is set in the environment (SHA256_RECORD_RATE=n
+ * samples one call in n), or from sha256_record_start(). The histogram is
+ * written to path at exit, or by sha256_record_dump(). bench -m replay
+ * regenerates traffic from it.
+ */
+#ifdef SHA256_RECORD
+#define SHA256_HIST_SUB 8
+#define SHA256_HIST_BUCKETS (62 * SHA256_HIST_SUB)
+
+static const char* const sha256_api_names[SHA256_API_COUNT] = {
+  "hash", "update", "final", "batch", "column", "compress", "batch_call",
+};
+
+static uint64_t sha256_hist[SHA256_API_COUNT][SHA256_HIST_BUCKETS];
+static int sha256_rec_on = -1;          // -1 until the environment is read
+static uint32_t sha256_rec_rate = 1;
+static char sha256_rec_path[4096];
+static __thread uint32_t sha256_rec_tick;
+
+static int sha256_hist_bucket(uint64_t v) {
+  if (v < 2 * SHA256_HIST_SUB) {
+    return (int)v;
+  }
+  int msb = 63 - __builtin_clzll(v);
+  return (msb - 2) * SHA256_HIST_SUB + (int)((v >> (msb - 3)) & (SHA256_HIST_SUB - 1));
+}
+
+static void sha256_hist_range(int b, uint64_t* lo, uint64_t* hi) {
+  if (b < 2 * SHA256_HIST_SUB) {
+    *lo = *hi = (uint64_t)b;
+    return;
+  }
+  int shift = b / SHA256_HIST_SUB - 1;
+  *lo = (uint64_t)(SHA256_HIST_SUB + b % SHA256_HIST_SUB) << shift;
+  *hi = *lo + ((uint64_t)1 << shift) - 1;
+}
+
+static void sha256_record_atexit(void) {
+  if (sha256_rec_path[0] != 0) {
+    sha256_record_dump(sha256_rec_path);
+  }
+}
+
+int sha256_record_start(const char* path, uint32_t rate) {
+  static int registered = 0;
+  if (path != NULL) {
+    if (strlen(path) >= sizeof(sha256_rec_path)) {
+      return -1;
+    }
+    strcpy(sha256_rec_path, path);
+    if (!__atomic_exchange_n(&registered, 1, __ATOMIC_RELAXED)) {
+      atexit(sha256_record_atexit);
+    }
+  }
+  sha256_rec_rate = rate ? rate : 1;
+  __atomic_store_n(&sha256_rec_on, 1, __ATOMIC_RELEASE);
+  return 0;
+}
+
+void sha256_record_stop(void) {
+  __atomic_store_n(&sha256_rec_on, 0, __ATOMIC_RELEASE);
+}
+
+int sha256_record_dump(const char* path) {
+  FILE* f = fopen(path, "w");
+  if (f == NULL) {
+    return -1;
+  }
+  fprintf(f, "# sha256 size histogram v1: api lo hi count\n# rate %u\n", sha256_rec_rate);
+  for (int a = 0; a < SHA256_API_COUNT; a++) {
+    for (int b = 0; b < SHA256_HIST_BUCKETS; b++) {
+      uint64_t n = __atomic_load_n(&sha256_hist[a][b], __ATOMIC_RELAXED);
+      if (n > 0) {
+        uint64_t lo, hi;
+        sha256_hist_range(b, &lo, &hi);
+        fprintf(f, "%s %llu %llu %llu\n", sha256_api_names[a], (unsigned long long)lo,
+                (unsigned long long)hi, (unsigned long long)n);
+      }
+    }
+  }
+  return fclose(f);
+}
+
+static int sha256_record_enabled(void) {
+  int on = __atomic_load_n(&sha256_rec_on, __ATOMIC_ACQUIRE);
+  if (on < 0) {
+    const char* path = getenv("SHA256_RECORD");
+    const char* rate = getenv("SHA256_RECORD_RATE");
+    if (path != NULL && path[0] != 0) {
+      sha256_record_start(path, rate ? (uint32_t)strtoul(rate, NULL, 10) : 1);
+      on = 1;
+    } else {
+      int unknown = -1;
+      __atomic_compare_exchange_n(&sha256_rec_on, &unknown, 0, 0, __ATOMIC_RELEASE,
+                                  __ATOMIC_RELAXED);
+      on = __atomic_load_n(&sha256_rec_on, __ATOMIC_ACQUIRE);
+    }
+  }
+  return on;
+}
+
+// Is this call sampled? Counts calls per thread against the rate.
+static int sha256_record_sample(void) {
+  if (!sha256_record_enabled()) {
+    return 0;
+  }
+  if (++sha256_rec_tick < sha256_rec_rate) {
+    return 0;
+  }
+  sha256_rec_tick = 0;
+  return 1;
+}
+
+static void sha256_record_len(int api, uint64_t len) {
+  __atomic_fetch_add(&sha256_hist[api][sha256_hist_bucket(len)], 1, __ATOMIC_RELAXED);
+}
+
+#define SHA256_RECORD_CALL(api, len)       \
+  do {                                     \
+    if (sha256_record_sample()) {          \
+      sha256_record_len((api), (len));     \
+    }                                      \
+  } while (0)
+#else
+#define SHA256_RECORD_CALL(api, len) ((void)0)
+#endif /* SHA256_RECORD */
+
+/*
+ * Latency statistics.
+ *
+ * Built with -DSHA256_STATS, the public entry points time one call in
+ * SHA256_STATS_RATE (default 64) per thread and add the latency to an
+ * HDR-style histogram (16 linear buckets per power of two, so values are
+ * within about 6%) keyed by API, size class and kernel. Each thread writes
+ * only its own histograms; sha256_stats_dump() merges them. Without the
+ * flag the hooks compile to nothing.
+ */
+#ifdef SHA256_STATS
+#define SHA256_STATS_SUB 16
+#define SHA256_STATS_BUCKETS (61 * SHA256_STATS_SUB)
+#define SHA256_STATS_SIZES SHA256_SIZE_CLASSES
+
+typedef struct sha256_stats_thread {
+  struct sha256_stats_thread* next;
+  uint64_t* hist[SHA256_API_COUNT][SHA256_STATS_SIZES][SHA256_NKERNELS];
+} sha256_stats_thread;
+
+static const char* const sha256_stats_api_names[SHA256_API_COUNT] = {
+  "hash", "update", "final", "batch", "column", "compress", "batch_call",
+};
+static const char* const sha256_stats_size_names[SHA256_STATS_SIZES] = {
+  "<=64", "<=256", "<=1K", "<=4K", "<=16K", "<=64K", "<=1M", ">1M",
+};
+
+static sha256_stats_thread* sha256_stats_threads;
+static __thread sha256_stats_thread* sha256_stats_self;
+static __thread uint32_t sha256_stats_tick;
+static uint32_t sha256_stats_rate;
+static uint64_t sha256_stats_ns0, sha256_stats_tsc0;
+
+static uint64_t sha256_stats_clock(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __builtin_ia32_rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static uint64_t sha256_stats_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void sha256_stats_atexit(void) {
+  const char* path = getenv("SHA256_STATS");
+  size_t n = path ? strlen(path) : 0;
+  FILE* f = n ? fopen(path, "w") : NULL;
+  if (f != NULL) {
+    sha256_stats_dump(f, n > 5 && strcmp(path + n - 5, ".json") == 0);
+    fclose(f);
+  }
+}
+
+static void sha256_stats_init(void) {
+  static int done = 0;
+  if (__atomic_exchange_n(&done, 1, __ATOMIC_ACQ_REL)) {
+    return;
+  }
+  const char* rate = getenv("SHA256_STATS_RATE");
+  sha256_stats_rate = rate ? (uint32_t)strtoul(rate, NULL, 10) : 64;
+  sha256_stats_rate = sha256_stats_rate ? sha256_stats_rate : 1;
+  sha256_stats_ns0 = sha256_stats_now_ns();
+  sha256_stats_tsc0 = sha256_stats_clock();
+  atexit(sha256_stats_atexit);
+}
+
+// Start time if this call is sampled, else 0.
+static inline uint64_t sha256_stats_begin(void) {
+  if (__builtin_expect(++sha256_stats_tick < sha256_stats_rate, 1)) {
+    return 0;
+  }
+  sha256_stats_tick = 0;
+  if (sha256_stats_rate == 0) {
+    sha256_stats_init();
+  }
+  return sha256_stats_clock();
+}
+
+static int sha256_stats_bucket(uint64_t v) {
+  if (v < SHA256_STATS_SUB) {
+    return (int)v;
+  }
+  int msb = 63 - __builtin_clzll(v);
+  return (msb - 3) * SHA256_STATS_SUB + (int)((v >> (msb - 4)) & (SHA256_STATS_SUB - 1));
+}
+
+// Largest value that falls in bucket b.
+static uint64_t sha256_stats_bucket_max(int b) {
+  if (b < SHA256_STATS_SUB) {
+    return (uint64_t)b;
+  }
+  int shift = b / SHA256_STATS_SUB - 1;
+  return ((uint64_t)(SHA256_STATS_SUB + b % SHA256_STATS_SUB + 1) << shift) - 1;
+}
+
+// kernel is the sha256_kernel value of the kernel that ran the call.
+static void sha256_stats_end(uint64_t t0, int api, uint64_t len, int kernel) {
+  uint64_t t = sha256_stats_clock() - t0;
+  sha256_stats_thread* st = sha256_stats_self;
+
+  if (st == NULL) {
+    st = calloc(1, sizeof(*st));
+    if (st == NULL) {
+      return;
+    }
+    st->next = __atomic_load_n(&sha256_stats_threads, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&sha256_stats_threads, &st->next, st, 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+    sha256_stats_self = st;
+  }
+
+  uint64_t** slot = &st->hist[api][sha256_size_class(len)][kernel];
+  uint64_t* h = *slot;
+  if (h == NULL) {
+    h = calloc(SHA256_STATS_BUCKETS, sizeof(uint64_t));
+    if (h == NULL) {
+      return;
+    }
+    __atomic_store_n(slot, h, __ATOMIC_RELEASE);
+  }
+  int b = sha256_stats_bucket(t);
+  __atomic_store_n(&h[b], h[b] + 1, __ATOMIC_RELAXED);
+}
+
+int sha256_stats_dump(FILE* f, int json) {
+  static uint64_t merged[SHA256_STATS_BUCKETS];
+
+  sha256_stats_init();
+  uint64_t ns1 = sha256_stats_now_ns(), tsc1 = sha256_stats_clock();
+  double ns_per_tick = ns1 > sha256_stats_ns0 && tsc1 > sha256_stats_tsc0 ?
+                       (double)(ns1 - sha256_stats_ns0) / (tsc1 - sha256_stats_tsc0) : 1.0;
+  int first = 1;
+
+  if (json) {
+    fprintf(f, "{\"rate\": %u, \"histograms\": [", sha256_stats_rate);
+  } else {
+    fprintf(f, "# one call in %u sampled; latencies in ns\n", sha256_stats_rate);
+    fprintf(f, "%-8s %-6s %-7s %10s %9s %9s %9s %9s %9s\n", "api", "size", "kernel", "samples",
+            "p50", "p90", "p99", "p999", "max");
+  }
+
+  for (int a = 0; a < SHA256_API_COUNT; a++) {
+    for (int s = 0; s < SHA256_STATS_SIZES; s++) {
+      for (int k = 0; k < SHA256_NKERNELS; k++) {
+        uint64_t total = 0;
+        memset(merged, 0, sizeof(merged));
+        for (sha256_stats_thread* st = __atomic_load_n(&sha256_stats_threads, __ATOMIC_ACQUIRE);
+             st != NULL; st = st->next) {
+          uint64_t* h = __atomic_load_n(&st->hist[a][s][k], __ATOMIC_ACQUIRE);
+          for (int b = 0; h != NULL && b < SHA256_STATS_BUCKETS; b++) {
+            uint64_t n = __atomic_load_n(&h[b], __ATOMIC_RELAXED);
+            merged[b] += n;
+            total += n;
+          }
+        }
+        if (total == 0) {
+          continue;
+        }
+
+        static const double qs[] = { 0.50, 0.90, 0.99, 0.999, 1.0 };
+        double pv[5];
+        uint64_t seen = 0;
+        int q = 0;
+        for (int b = 0; b < SHA256_STATS_BUCKETS && q < 5; b++) {
+          seen += merged[b];
+          while (q < 5 && seen > 0 && seen >= qs[q] * total) {
+            pv[q++] = sha256_stats_bucket_max(b) * ns_per_tick;
+          }
+        }
+
+        const char* kname = sha256_kernel_name((sha256_kernel)k);
+        if (!json) {
+          fprintf(f, "%-8s %-6s %-7s %10llu %9.0f %9.0f %9.0f %9.0f %9.0f\n",
+                  sha256_stats_api_names[a], sha256_stats_size_names[s], kname,
+                  (unsigned long long)total, pv[0], pv[1], pv[2], pv[3], pv[4]);
+          continue;
+        }
+        fprintf(f, "%s\n  {\"api\": \"%s\", \"size\": \"%s\", \"kernel\": \"%s\", "
+                "\"samples\": %llu, \"p50\": %.0f, \"p90\": %.0f, \"p99\": %.0f, "
+                "\"p999\": %.0f, \"max\": %.0f, \"buckets\": [", first ? "" : ",",
+                sha256_stats_api_names[a], sha256_stats_size_names[s], kname,
+                (unsigned long long)total, pv[0], pv[1], pv[2], pv[3], pv[4]);
+        first = 0;
+        int firstb = 1;
+        for (int b = 0; b < SHA256_STATS_BUCKETS; b++) {
+          if (merged[b] > 0) {
+            fprintf(f, "%s[%.0f, %llu]", firstb ? "" : ", ", sha256_stats_bucket_max(b) * ns_per_tick,
+                    (unsigned long long)merged[b]);
+            firstb = 0;
+          }
+        }
+        fprintf(f, "]}");
+      }
+    }
+  }
+  if (json) {
+    fprintf(f, "\n]}\n");
+  }
+  return ferror(f) ? -1 : 0;
+}
+
+void sha256_stats_reset(void) {
+  for (sha256_stats_thread* st = __atomic_load_n(&sha256_stats_threads, __ATOMIC_ACQUIRE);
+       st != NULL; st = st->next) {
+    for (int a = 0; a < SHA256_API_COUNT; a++) {
+      for (int s = 0; s < SHA256_STATS_SIZES; s++) {
+        for (int k = 0; k < SHA256_NKERNELS; k++) {
+          uint64_t* h = __atomic_load_n(&st->hist[a][s][k], __ATOMIC_ACQUIRE);
+          for (int b = 0; h != NULL && b < SHA256_STATS_BUCKETS; b++) {
+            __atomic_store_n(&h[b], 0, __ATOMIC_RELAXED);
+          }
+        }
+      }
+    }
+  }
+}
+
+#define SHA256_STATS_BEGIN(t0) uint64_t t0 = sha256_stats_begin()
+// len and kernel are only evaluated for sampled calls.
+#define SHA256_STATS_END(t0, api, len, kernel)           \
+  do {                                                   \
+    if (__builtin_expect((t0) != 0, 0)) {                \
+      sha256_stats_end((t0), (api), (len), (kernel));    \
+    }                                                    \
+  } while (0)
+
+// The kernel that ran blocks without a message size (streaming, compress).
+#define SHA256_KERNEL_CUR() sha256_kernel_of(sha256_blocks_kernel())
+#else
+#define SHA256_STATS_BEGIN(t0)
+#define SHA256_STATS_END(t0, api, len, kernel) ((void)0)
+#endif /* SHA256_STATS */
+
+void sha256_compress(uint32_t state[8], const unsigned char* blocks, uint64_t nblocks) {
+  SHA256_RECORD_CALL(SHA256_API_COMPRESS, 64 * nblocks);
+  SHA256_STATS_BEGIN(t0);
+  sha256_blocks(state, blocks, nblocks);
+  SHA256_STATS_END(t0, SHA256_API_COMPRESS, 64 * nblocks, SHA256_KERNEL_CUR());
+}
+
+void sha256_compress_batch(uint32_t (*states)[8], const unsigned char* const* blocks,
+                           uint64_t nblocks, uint64_t n) {
+  uint64_t i = 0;
+  int lanes = 1;
+
+  SHA256_RECORD_CALL(SHA256_API_COMPRESS, 64 * nblocks * n);
+  SHA256_STATS_BEGIN(t0);
+
+#ifdef SHA256_HAVE_AVX2
+  if (n >= 8 && sha256_use_x8_len(64 * nblocks)) {
+    lanes = 8;
+    uint32_t S[8][8];
+    const unsigned char* blk[8];
+
+    for (; i + 8 <= n; i += 8) {
+      for (int l = 0; l < 8; l++) {
+        blk[l] = blocks[i+l];
+        for (int w = 0; w < 8; w++) {
+          S[w][l] = states[i+l][w];
+        }
+      }
+      for (uint64_t k = 0; k < nblocks; k++) {
+        sha256_x8_avx2(S, blk);
+        for (int l = 0; l < 8; l++) {
+          blk[l] += 64;
+        }
+      }
+      for (int l = 0; l < 8; l++) {
+        for (int w = 0; w < 8; w++) {
+          states[i+l][w] = S[w][l];
+        }
+      }
+    }
+  }
+#endif
+
+  for (; i < n; i++) {
+    sha256_blocks(states[i], blocks[i], nblocks);
+  }
+  (void)lanes;
+  SHA256_STATS_END(t0, SHA256_API_COMPRESS, 64 * nblocks * n,
+                   lanes == 8 ? SHA256_KERNEL_AVX2_X8 : SHA256_KERNEL_CUR());
+}
+
+/*
+ * SHA-256 and SHA-224 share the compression function and every kernel; they
+ * differ only in the initial hash value and how many state words make up the
+ * digest.
+ */
+typedef struct {
+  const uint32_t* iv;
+  int digest_words;
+} sha256_variant;
+
+static const sha256_variant SHA256_VARIANT = { H0, 8 };
+static const sha256_variant SHA224_VARIANT = { H0_224, 7 };
+
+static void sha256_store_digest(const sha256_variant* v, unsigned char* digest, const uint32_t H[8]) {
+  for (int i = 0; i < v->digest_words; i++) {
+    sha256_store_be32(digest + 4*i, H[i]);
+  }
+}
+
+// Hash one message with fn, the kernel sha256_blocks_for(len) picked.
+static void sha256_oneshot(const sha256_variant* v, sha256_blocks_fn fn,
+                           const unsigned char* msg, uint64_t len, unsigned char* digest) {
+  uint32_t H[8];
+  unsigned char tail[128];
+
+  memcpy(H, v->iv, sizeof(H));
+  fn(H, msg, len / 64);
+  int ntail = sha256_pad_tail(tail, msg + (len - len % 64), len);
+  fn(H, tail, ntail);
+  sha256_store_digest(v, digest, H);
+}
+
+void sha256_hash(const unsigned char* msg, uint64_t len, unsigned char digest[32]) {
+  SHA256_RECORD_CALL(SHA256_API_HASH, len);
+  SHA256_STATS_BEGIN(t0);
+  sha256_blocks_fn fn = sha256_blocks_for(len);
+  SHA256_PROBE2(hash__start, len, sha256_kernel_of(fn));
+  sha256_oneshot(&SHA256_VARIANT, fn, msg, len, digest);
+  SHA256_PROBE2(hash__done, len, sha256_kernel_of(fn));
+  SHA256_STATS_END(t0, SHA256_API_HASH, len, sha256_kernel_of(fn));
+}
+
+void sha224_hash(const unsigned char* msg, uint64_t len, unsigned char digest[28]) {
+  SHA256_RECORD_CALL(SHA256_API_HASH, len);
+  SHA256_STATS_BEGIN(t0);
+  sha256_blocks_fn fn = sha256_blocks_for(len);
+  SHA256_PROBE2(hash__start, len, sha256_kernel_of(fn));
+  sha256_oneshot(&SHA224_VARIANT, fn, msg, len, digest);
+  SHA256_PROBE2(hash__done, len, sha256_kernel_of(fn));
+  SHA256_STATS_END(t0, SHA256_API_HASH, len, sha256_kernel_of(fn));
+}
+
+/*
+ * Streaming interface.
+ *
+ * Whole blocks go straight from the caller's buffer to the kernel; only a
+ * partial block is kept in the context between updates.
+ */
+static void sha256_ctx_init(sha256_ctx* ctx, const sha256_variant* v) {
+  memcpy(ctx->H, v->iv, sizeof(ctx->H));
+  ctx->len = 0;
+  ctx->buflen = 0;
+  ctx->digest_words = v->digest_words;
+}
+
+void sha256_init(sha256_ctx* ctx) {
+  sha256_ctx_init(ctx, &SHA256_VARIANT);
+}
+
+void sha224_init(sha256_ctx* ctx) {
+  sha256_ctx_init(ctx, &SHA224_VARIANT);
+}
+
+void sha256_update(sha256_ctx* ctx, const unsigned char* data, uint64_t len) {
+  SHA256_RECORD_CALL(SHA256_API_UPDATE, len);
+  SHA256_STATS_BEGIN(t0);
+#ifdef SHA256_STATS
+  uint64_t len0 = ctx->len;
+#endif
+  ctx->len += len;
+
+  // Top up a partial block first.
+  if (ctx->buflen > 0) {
+    uint64_t take = 64 - ctx->buflen < len ? 64 - ctx->buflen : len;
+    memcpy(ctx->buf + ctx->buflen, data, take);
+    ctx->buflen += take;
+    data += take;
+    len -= take;
+    if (ctx->buflen < 64) {
+      SHA256_STATS_END(t0, SHA256_API_UPDATE, ctx->len - len0, SHA256_KERNEL_CUR());
+      return;
+    }
+    sha256_blocks(ctx->H, ctx->buf, 1);
+    ctx->buflen = 0;
+  }
+
+  if (len >= 64) {
+    sha256_blocks(ctx->H, data, len / 64);
+    data += len - len % 64;
+    len %= 64;
+  }
+
+  memcpy(ctx->buf, data, len);
+  ctx->buflen = len;
+  SHA256_STATS_END(t0, SHA256_API_UPDATE, ctx->len - len0, SHA256_KERNEL_CUR());
+}
+
+void sha256_final(const sha256_ctx* ctx, unsigned char* digest) {
+  uint32_t H[8];
+  unsigned char tail[128];
+
+  SHA256_RECORD_CALL(SHA256_API_FINAL, ctx->len);
+  SHA256_STATS_BEGIN(t0);
+
+  memcpy(H, ctx->H, sizeof(H));
+  int ntail = sha256_pad_tail(tail, ctx->buf, ctx->len);
+  sha256_blocks(H, tail, ntail);
+
+  for (uint32_t i = 0; i < ctx->digest_words; i++) {
+    sha256_store_be32(digest + 4*i, H[i]);
+  }
+  SHA256_STATS_END(t0, SHA256_API_FINAL, ctx->len, SHA256_KERNEL_CUR());
+}
+
+/*
+ * Lane scheduler.
+ *
+ * A lane walks one message: first its whole blocks in place, then its padded
+ * tail. When a lane finishes, its digest is written out and the lane is
+ * refilled with the next row, so all lanes stay busy until rows run out.
+ */
+typedef struct {
+  const unsigned char* next;   // next whole block, in the caller's buffer
+  uint64_t nfull;              // whole blocks left
+  unsigned char tail[128];     // padded final block(s)
+  int ntail;                   // number of padded blocks
+  int tailpos;                 // padded blocks already consumed
+  int active;
+  uint64_t row;
+} sha256_lane;
+
+static void lane_start(sha256_lane* ln, const unsigned char* msg, uint64_t len, uint64_t row) {
+  ln->next = msg;
+  ln->nfull = len / 64;
+  ln->ntail = sha256_pad_tail(ln->tail, msg + (len - len % 64), len);
+  ln->tailpos = 0;
+  ln->active = 1;
+  ln->row = row;
+}
+
+static const unsigned char* lane_block(sha256_lane* ln) {
+  if (ln->nfull > 0) {
+    const unsigned char* p = ln->next;
+    ln->next += 64;
+    ln->nfull--;
+    return p;
+  }
+  return ln->tail + 64 * ln->tailpos++;
+}
+
+static int lane_done(const sha256_lane* ln) {
+  return ln->nfull == 0 && ln->tailpos == ln->ntail;
+}
+
+/*
+ * A set of rows to hash: either an Arrow column (offsets plus data) or a
+ * list of message pointers and lengths. Digests go either to one contiguous
+ * array or to one pointer per row.
+ */
+typedef struct {
+  const sha256_variant* v;
+  const void* offsets;            // Arrow offsets, or NULL for msgs/lens
+  int wide;                       // offsets are int64 rather than int32
+  const unsigned char* data;
+  const unsigned char* const* msgs;
+  const uint64_t* lens;
+  unsigned char* digests;         // contiguous output, or NULL for outs
+  unsigned char* const* outs;
+} sha256_rowset;
+
+static inline const unsigned char* row_msg(const sha256_rowset* rs, uint64_t i, uint64_t* len) {
+  if (rs->offsets == NULL) {
+    *len = rs->lens[i];
+    return rs->msgs[i];
+  }
+  uint64_t lo, hi;
+  if (rs->wide) {
+    lo = (uint64_t)((const int64_t*)rs->offsets)[i];
+    hi = (uint64_t)((const int64_t*)rs->offsets)[i+1];
+  } else {
+    lo = (uint64_t)((const int32_t*)rs->offsets)[i];
+    hi = (uint64_t)((const int32_t*)rs->offsets)[i+1];
+  }
+  *len = hi - lo;
+  return rs->data + lo;
+}
+
+static inline unsigned char* row_digest(const sha256_rowset* rs, uint64_t i) {
+  return rs->digests ? rs->digests + 4*rs->v->digest_words*i : rs->outs[i];
+}
+
+static void lane_start_row(sha256_lane* ln, const sha256_rowset* rs, uint64_t row) {
+  uint64_t len;
+  const unsigned char* msg = row_msg(rs, row, &len);
+  lane_start(ln, msg, len, row);
+}
+
+// Mean length of rows [begin, end); only needed once the choice is tuned.
+static uint64_t sha256_rows_avg_len(const sha256_rowset* rs, uint64_t begin, uint64_t end) {
+  uint64_t total = 0;
+  if (sha256_tune_table_cur() == NULL || end == begin) {
+    return 0;
+  }
+  if (rs->offsets != NULL) {
+    uint64_t len;
+    total = (uint64_t)(row_msg(rs, end - 1, &len) - row_msg(rs, begin, &len)) + len;
+  } else {
+    for (uint64_t i = begin; i < end; i++) {
+      total += rs->lens[i];
+    }
+  }
+  return total / (end - begin);
+}
+
+#ifdef SHA256_HAVE_AVX2
+// Hash rows [begin, end), end - begin >= 8, through the 8-lane kernel.
+static void sha256_rows_x8(const sha256_rowset* rs, uint64_t begin, uint64_t end) {
+  const sha256_variant* v = rs->v;
+  uint32_t S[8][8];
+  sha256_lane lanes[8];
+  const unsigned char* blk[8];
+  uint64_t row = begin;
+
+  for (int l = 0; l < 8; l++, row++) {
+    lane_start_row(&lanes[l], rs, row);
+    for (int w = 0; w < 8; w++) {
+      S[w][l] = v->iv[w];
+    }
+  }
+
+  // Run all eight lanes until one finishes with no row left to refill it.
+  int full = 1;
+  while (full) {
+    for (int l = 0; l < 8; l++) {
+      blk[l] = lane_block(&lanes[l]);
+    }
+    sha256_x8_avx2(S, blk);
+
+    for (int l = 0; l < 8; l++) {
+      if (!lane_done(&lanes[l])) {
+        continue;
+      }
+      unsigned char* digest = row_digest(rs, lanes[l].row);
+      for (int w = 0; w < v->digest_words; w++) {
+        sha256_store_be32(digest + 4*w, S[w][l]);
+      }
+      if (row < end) {
+        lane_start_row(&lanes[l], rs, row);
+        for (int w = 0; w < 8; w++) {
+          S[w][l] = v->iv[w];
+        }
+        row++;
+      } else {
+        lanes[l].active = 0;
+        full = 0;
+      }
+    }
+  }
+
+  // Finish the lanes still in flight one at a time.
+  for (int l = 0; l < 8; l++) {
+    sha256_lane* ln = &lanes[l];
+    if (!ln->active) {
+      continue;
+    }
+    uint32_t H[8];
+    for (int w = 0; w < 8; w++) {
+      H[w] = S[w][l];
+    }
+    sha256_blocks(H, ln->next, ln->nfull);
+    sha256_blocks(H, ln->tail + 64*ln->tailpos, ln->ntail - ln->tailpos);
+    sha256_store_digest(v, row_digest(rs, ln->row), H);
+  }
+}
+#endif /* SHA256_HAVE_AVX2 */
+
+// Hash rows [begin, end); returns 8 if they went through the 8-lane
+// kernel, else 1.
+static int sha256_rows_range(const sha256_rowset* rs, uint64_t begin, uint64_t end) {
+  int lanes = 1;
+#ifdef SHA256_HAVE_AVX2
+  if (end - begin >= 8 && sha256_use_x8_len(sha256_rows_avg_len(rs, begin, end))) {
+    lanes = 8;
+  }
+#endif
+  SHA256_PROBE2(batch__dispatch, end - begin, lanes);
+#ifdef SHA256_HAVE_AVX2
+  if (lanes == 8) {
+    sha256_rows_x8(rs, begin, end);
+    return lanes;
+  }
+#endif
+  for (uint64_t i = begin; i < end; i++) {
+    uint64_t len;
+    const unsigned char* msg = row_msg(rs, i, &len);
+    sha256_oneshot(rs->v, sha256_blocks_for(len), msg, len, row_digest(rs, i));
+  }
+  return lanes;
+}
+
+#ifdef SHA256_RECORD
+// A sampled batch call records its size and every row length.
+static void sha256_record_rows(const sha256_rowset* rs, int api, uint64_t nrows) {
+  if (!sha256_record_sample()) {
+    return;
+  }
+  sha256_record_len(SHA256_API_BATCH_CALL, nrows);
+  for (uint64_t i = 0; i < nrows; i++) {
+    uint64_t len;
+    row_msg(rs, i, &len);
+    sha256_record_len(api, len);
+  }
+}
+#endif
+
+#ifdef SHA256_STATS
+// Batch latencies are keyed by the bytes hashed in the call.
+static uint64_t sha256_rows_bytes(const sha256_rowset* rs, uint64_t nrows) {
+  uint64_t total = 0;
+  for (uint64_t i = 0; i < nrows; i++) {
+    uint64_t len;
+    row_msg(rs, i, &len);
+    total += len;
+  }
+  return total;
+}
+
+// ... and by the 8-lane kernel if any rows went through it, else by the
+// kernel picked for the mean row length.
+static int sha256_rows_kernel(const sha256_rowset* rs, uint64_t nrows, int lanes) {
+  if (lanes == 8) {
+    return SHA256_KERNEL_AVX2_X8;
+  }
+  return sha256_kernel_of(sha256_blocks_for(nrows ? sha256_rows_bytes(rs, nrows) / nrows : 0));
+}
+#endif
+
+// Rows per unit of work handed to a thread.
+#define SHA256_COLUMN_CHUNK 4096
+
+// Returns 8 if any chunk went through the 8-lane kernel, else 1.
+static int sha256_rows(const sha256_rowset* rs, uint64_t nrows) {
+  int64_t nchunks = (int64_t)((nrows + SHA256_COLUMN_CHUNK - 1) / SHA256_COLUMN_CHUNK);
+  int lanes = 1;
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) reduction(max:lanes)
+#endif
+  for (int64_t i = 0; i < nchunks; i++) {
+    uint64_t begin = (uint64_t)i * SHA256_COLUMN_CHUNK;
+    uint64_t end = begin + SHA256_COLUMN_CHUNK < nrows ? begin + SHA256_COLUMN_CHUNK : nrows;
+    int l = sha256_rows_range(rs, begin, end);
+    lanes = l > lanes ? l : lanes;
+  }
+  return lanes;
+}
+
+static void sha256_column_impl(const sha256_variant* v, const void* offsets, int wide,
+                               const unsigned char* data, uint64_t nrows,
+                               unsigned char* digests) {
+  sha256_rowset rs = { v, offsets, wide, data, NULL, NULL, digests, NULL };
+#ifdef SHA256_RECORD
+  sha256_record_rows(&rs, SHA256_API_COLUMN, nrows);
+#endif
+  SHA256_STATS_BEGIN(t0);
+  int lanes = sha256_rows(&rs, nrows);
+  (void)lanes;
+  SHA256_STATS_END(t0, SHA256_API_COLUMN, sha256_rows_bytes(&rs, nrows),
+                   sha256_rows_kernel(&rs, nrows, lanes));
+}
+
+void sha256_column(const int32_t* offsets, const unsigned char* data,
+                   uint64_t nrows, unsigned char* digests) {
+  sha256_column_impl(&SHA256_VARIANT, offsets, 0, data, nrows, digests);
+}
+
+void sha256_column64(const int64_t* offsets, const unsigned char* data,
+                     uint64_t nrows, unsigned char* digests) {
+  sha256_column_impl(&SHA256_VARIANT, offsets, 1, data, nrows, digests);
+}
+
+void sha224_column(const int32_t* offsets, const unsigned char* data,
+                   uint64_t nrows, unsigned char* digests) {
+  sha256_column_impl(&SHA224_VARIANT, offsets, 0, data, nrows, digests);
+}
+
+void sha224_column64(const int64_t* offsets, const unsigned char* data,
+                     uint64_t nrows, unsigned char* digests) {
+  sha256_column_impl(&SHA224_VARIANT, offsets, 1, data, nrows, digests);
+}
+
+void sha256_hash_batch(const unsigned char* const* msgs, const uint64_t* lens, uint64_t n,
+                       unsigned char* const* digests) {
+  sha256_rowset rs = { &SHA256_VARIANT, NULL, 0, NULL, msgs, lens, NULL, digests };
+#ifdef SHA256_RECORD
+  sha256_record_rows(&rs, SHA256_API_BATCH, n);
+#endif
+  SHA256_STATS_BEGIN(t0);
+  int lanes = sha256_rows_range(&rs, 0, n);
+  (void)lanes;
+  SHA256_STATS_END(t0, SHA256_API_BATCH, sha256_rows_bytes(&rs, n),
+                   sha256_rows_kernel(&rs, n, lanes));
+}
+
+/*
+ * Autotuning.
+ *
+ * CPUID says which kernels can run, not which is fastest: frequency drops
+ * under wide vectors, SMT siblings sharing the SHA unit and per-call
+ * overheads on small messages all move the crossover. sha256_autotune()
+ * times every usable kernel at one size per class, for a single message
+ * and for a batch of eight, and keeps the winners. Results are cached in a
+ * small text file named after a hash of the CPU brand string and features,
+ * so later starts read a few hundred bytes instead of rerunning the timings.
+ */
+static __thread volatile uint32_t sha256_tune_sink;   // per thread: tunes may overlap
+
+// Message size timed for each class.
+static const uint64_t sha256_tune_sizes[SHA256_SIZE_CLASSES] = {
+  64, 256, 1024, 4096, 16384, 65536, 262144, (1u << 20) + 64,
+};
+
+static void sha256_tune_key(char* key, size_t len) {
+  unsigned int r[12] = { 0 };
+#ifdef SHA256_HAVE_AVX2
+  for (unsigned int i = 0; i < 3; i++) {
+    if (!__get_cpuid(0x80000002 + i, &r[4*i], &r[4*i+1], &r[4*i+2], &r[4*i+3])) {
+      break;
+    }
+  }
+#endif
+  char brand[49] = { 0 };
+  memcpy(brand, r, 48);
+  const char* b = brand;
+  while (*b == ' ') {
+    b++;
+  }
+  snprintf(key, len, "%s;shani=%d;avx2=%d", b, sha256_kernel_supported(SHA256_KERNEL_SHANI),
+           sha256_kernel_supported(SHA256_KERNEL_AVX2_X8));
+}
+
+// dir/sha256-tune-<first 8 bytes of SHA-256(key) in hex>
+static void sha256_tune_path(const char* dir, const char* key, char* path, size_t len) {
+  unsigned char d[32];
+  char hex[17];
+  sha256_oneshot(&SHA256_VARIANT, sha256_blocks_kernel(), (const unsigned char*)key,
+                 strlen(key), d);
+  for (int i = 0; i < 8; i++) {
+    snprintf(hex + 2*i, 3, "%02x", d[i]);
+  }
+  snprintf(path, len, "%s/sha256-tune-%s", dir, hex);
+}
+
+static sha256_blocks_fn sha256_tune_fn(sha256_kernel k) {
+#ifdef SHA256_HAVE_AVX2
+  if (k == SHA256_KERNEL_SHANI) {
+    return sha256_blocks_shani;
+  }
+#endif
+  return k == SHA256_KERNEL_SCALAR ? sha256_blocks_scalar : NULL;
+}
+
+static sha256_kernel sha256_tune_kernel_by_name(const char* name) {
+  for (int k = SHA256_KERNEL_SCALAR; k < SHA256_NKERNELS; k++) {
+    if (strcmp(sha256_kernel_name((sha256_kernel)k), name) == 0 &&
+        sha256_kernel_supported((sha256_kernel)k)) {
+      return (sha256_kernel)k;
+    }
+  }
+  return SHA256_KERNEL_AUTO;
+}
+
+/*
+ * File format, one class per column:
+ *
+ *   # sha256 autotune v1
+ *   cpu <key>
+ *   single shani shani ...
+ *   batch avx2x8 avx2x8 shani ...
+ */
+static int sha256_tune_load(const char* path, const char* key, sha256_blocks_fn* single,
+                            int* x8) {
+  char line[512];
+  int got = 0;
+  FILE* f = fopen(path, "r");
+  if (f == NULL) {
+    return -1;
+  }
+  while (fgets(line, sizeof(line), f) != NULL) {
+    line[strcspn(line, "\n")] = 0;
+    if (strncmp(line, "cpu ", 4) == 0) {
+      got |= strcmp(line + 4, key) == 0 ? 1 : 8;
+      continue;
+    }
+    int is_single = strncmp(line, "single ", 7) == 0;
+    if (!is_single && strncmp(line, "batch ", 6) != 0) {
+      continue;
+    }
+    char* save = NULL;
+    int c = 0;
+    for (char* tok = strtok_r(line + (is_single ? 7 : 6), " ", &save);
+         tok != NULL && c < SHA256_SIZE_CLASSES; tok = strtok_r(NULL, " ", &save), c++) {
+      sha256_kernel k = sha256_tune_kernel_by_name(tok);
+      if (is_single && sha256_tune_fn(k) != NULL) {
+        single[c] = sha256_tune_fn(k);
+      } else if (!is_single && k != SHA256_KERNEL_AUTO) {
+        x8[c] = k == SHA256_KERNEL_AVX2_X8;
+      } else {
+        break;
+      }
+    }
+    if (c == SHA256_SIZE_CLASSES) {
+      got |= is_single ? 2 : 4;
+    }
+  }
+  fclose(f);
+  return got == 7 ? 0 : -1;
+}
+
+static int sha256_tune_save(const char* path, const char* key, const sha256_blocks_fn* single,
+                            const int* x8) {
+  char tmp[1100];
+  snprintf(tmp, sizeof(tmp), "%s.%ld", path, (long)getpid());
+  FILE* f = fopen(tmp, "w");
+  if (f == NULL) {
+    return -1;
+  }
+  fprintf(f, "# sha256 autotune v1\ncpu %s\nsingle", key);
+  for (int c = 0; c < SHA256_SIZE_CLASSES; c++) {
+    fprintf(f, " %s", single[c] == sha256_blocks_scalar ? "scalar" : "shani");
+  }
+  fprintf(f, "\nbatch");
+  for (int c = 0; c < SHA256_SIZE_CLASSES; c++) {
+    fprintf(f, " %s", x8[c] ? "avx2x8" : single[c] == sha256_blocks_scalar ? "scalar" : "shani");
+  }
+  fprintf(f, "\n");
+  // Rename into place so a concurrent reader never sees half a file.
+  if (fclose(f) != 0 || rename(tmp, path) != 0) {
+    remove(tmp);
+    return -1;
+  }
+  return 0;
+}
+
+static uint64_t sha256_tune_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Best of three runs, in ns per message: one message at a time through fn.
+static double sha256_tune_time_single(sha256_blocks_fn fn, const unsigned char* msg,
+                                      uint64_t len, uint64_t reps) {
+  double best = 1e30;
+  for (int t = 0; t < 3; t++) {
+    uint64_t t0 = sha256_tune_now();
+    for (uint64_t r = 0; r < reps; r++) {
+      uint32_t H[8];
+      unsigned char tail[128];
+      memcpy(H, SHA256_VARIANT.iv, sizeof(H));
+      fn(H, msg, len / 64);
+      int ntail = sha256_pad_tail(tail, msg + (len - len % 64), len);
+      fn(H, tail, ntail);
+      sha256_tune_sink ^= H[0];
+    }
+    double ns = (double)(sha256_tune_now() - t0) / reps;
+    best = ns < best ? ns : best;
+  }
+  return best;
+}
+
+#ifdef SHA256_HAVE_AVX2
+// ... eight messages at a time through the 8-lane kernel.
+static double sha256_tune_time_x8(const unsigned char* msg, uint64_t len, uint64_t reps) {
+  const unsigned char* msgs[8];
+  uint64_t lens[8];
+  unsigned char digests[8][32];
+  unsigned char* outs[8];
+  for (int i = 0; i < 8; i++) {
+    msgs[i] = msg;
+    lens[i] = len;
+    outs[i] = digests[i];
+  }
+  sha256_rowset rs = { &SHA256_VARIANT, NULL, 0, NULL, msgs, lens, NULL, outs };
+
+  double best = 1e30;
+  for (int t = 0; t < 3; t++) {
+    uint64_t t0 = sha256_tune_now();
+    for (uint64_t r = 0; r < reps; r++) {
+      sha256_rows_x8(&rs, 0, 8);
+      sha256_tune_sink ^= digests[7][0];
+    }
+    double ns = (double)(sha256_tune_now() - t0) / reps / 8;
+    best = ns < best ? ns : best;
+  }
+  return best;
+}
+#endif
+
+static int sha256_tune_measure(sha256_blocks_fn* single, int* x8) {
+  const uint64_t budget = 1u << 18;      // bytes hashed per timing run
+  unsigned char* buf = malloc(sha256_tune_sizes[SHA256_SIZE_CLASSES - 1]);
+  if (buf == NULL) {
+    return -1;
+  }
+  for (uint64_t i = 0; i < sha256_tune_sizes[SHA256_SIZE_CLASSES - 1]; i++) {
+    buf[i] = (unsigned char)(i * 2654435761u >> 24);
+  }
+
+  for (int c = 0; c < SHA256_SIZE_CLASSES; c++) {
+    uint64_t len = sha256_tune_sizes[c];
+    uint64_t reps = budget / len ? budget / len : 1;
+    double best = 1e30;
+
+    single[c] = sha256_blocks_scalar;
+    x8[c] = 0;
+    for (int k = SHA256_KERNEL_SCALAR; k < SHA256_NKERNELS; k++) {
+      sha256_blocks_fn fn = sha256_tune_fn((sha256_kernel)k);
+      if (fn == NULL || !sha256_kernel_supported((sha256_kernel)k)) {
+        continue;
+      }
+      double ns = sha256_tune_time_single(fn, buf, len, reps);
+      if (ns < best) {
+        best = ns;
+        single[c] = fn;
+      }
+    }
+#ifdef SHA256_HAVE_AVX2
+    if (sha256_kernel_supported(SHA256_KERNEL_AVX2_X8)) {
+      uint64_t reps8 = reps / 8 ? reps / 8 : 1;
+      x8[c] = sha256_tune_time_x8(buf, len, reps8) < best;
+    }
+#endif
+  }
+  free(buf);
+  return 0;
+}
+
+int sha256_autotune(const char* dir, int force) {
+  char key[256], dir_buf[1024], path[1064];
+  sha256_tune_table* tune = malloc(sizeof(*tune));
+  if (tune == NULL) {
+    return -1;
+  }
+
+  sha256_blocks_kernel();
+  sha256_tune_key(key, sizeof(key));
+  if (dir == NULL) {
+    const char* xdg = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+    if (xdg != NULL && *xdg) {
+      snprintf(dir_buf, sizeof(dir_buf), "%s", xdg);
+    } else if (home != NULL && *home) {
+      snprintf(dir_buf, sizeof(dir_buf), "%s/.cache", home);
+      mkdir(dir_buf, 0755);
+    } else {
+      snprintf(dir_buf, sizeof(dir_buf), "/tmp");
+    }
+    dir = dir_buf;
+  }
+  sha256_tune_path(dir, key, path, sizeof(path));
+
+  int rc = 0;
+  if (force || sha256_tune_load(path, key, tune->single, tune->x8) != 0) {
+    if (sha256_tune_measure(tune->single, tune->x8) != 0) {
+      free(tune);
+      return -1;
+    }
+    rc = sha256_tune_save(path, key, tune->single, tune->x8) == 0 ? 0 : 1;
+  }
+
+  __atomic_store_n(&sha256_tune_last, tune, __ATOMIC_RELEASE);
+  if (sha256_get_kernel() == SHA256_KERNEL_AUTO) {
+    sha256_select_kernel(SHA256_KERNEL_AUTO);
+  }
+  return rc;
+}
+
+// SHA256_AUTOTUNE=1 tunes on first use with the default cache directory;
+// any other non-empty value names the directory.
+static void sha256_autotune_env(void) {
+  const char* v = getenv("SHA256_AUTOTUNE");
+  if (v != NULL && *v && strcmp(v, "0") != 0) {
+    sha256_autotune(strcmp(v, "1") == 0 ? NULL : v, 0);
+  }
+}
+
 void printbytes(unsigned char* bytes, int len) {
   for (int i = 0; i < len; i++) {
     printf("%02X", bytes[i]);
@@ -219,6 +1658,7 @@ void printwords(uint32_t* words, int len) {
   }
 }
 
+#ifndef SHA256_NO_MAIN
 int main() {
   //unsigned char* msg = (unsigned char*)"abc";
   unsigned char* msg = (unsigned char*)"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
@@ -253,6 +1693,12 @@ int main() {
   printbytes((unsigned char*)digest, 32);
   printf("\n");
 
+  unsigned char digest224[28];
+  sha224_hash(msg, msgbytelen, digest224);
+  printf("sha224: ");
+  printbytes(digest224, 28);
+  printf("\n");
+
   // Free memory
   free(msg_pad);
   for (int i = 0; i < numblks; i++) {
@@ -262,3 +1708,4 @@ int main() {
 
   return 0;
 }
+#endif /* SHA256_NO_MAIN */
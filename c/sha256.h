@@ -0,0 +1,178 @@
+/**
+ * sha256.h - Public interface of the SHA-256 implementation in sha256.c.
+ */
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Reference implementation.
+ *
+ * These follow the FIPS 180-4 steps one by one (pad, parse, compute).
+ * Built with -DSHA256_TRACE they print their intermediate values. They are
+ * meant for reading, not speed.
+ */
+unsigned char* padmsg(unsigned char* M, uint64_t* len, uint64_t* newbitlen);
+unsigned char** parse_msg_blocks(unsigned char* paddedmsg, uint64_t* numblks);
+unsigned char** preprocess_msg(unsigned char* msg, uint64_t* msglen, uint64_t* numblks);
+uint32_t* sha256_compute(unsigned char** msgblks, uint64_t* numblks);
+uint32_t* sha256(unsigned char* msg, uint64_t* msglen);
+
+/*
+ * One-shot hashing.
+ *
+ * Hash len bytes at msg in place. SHA-224 runs the same kernels as SHA-256
+ * from its own IV and keeps the first 28 bytes of the state.
+ */
+void sha256_hash(const unsigned char* msg, uint64_t len, unsigned char digest[32]);
+void sha224_hash(const unsigned char* msg, uint64_t len, unsigned char digest[28]);
+
+/*
+ * Streaming hashing.
+ *
+ * The context holds no pointers, so copying the struct forks the midstate
+ * (e.g. to hash several messages sharing a prefix). sha256_final() leaves
+ * the context untouched and writes 32 bytes, or 28 after sha224_init().
+ */
+typedef struct {
+  uint32_t H[8];
+  uint64_t len;              // bytes absorbed so far
+  unsigned char buf[64];     // pending partial block
+  uint32_t buflen;
+  uint32_t digest_words;
+} sha256_ctx;
+
+void sha256_init(sha256_ctx* ctx);
+void sha224_init(sha256_ctx* ctx);
+void sha256_update(sha256_ctx* ctx, const unsigned char* data, uint64_t len);
+void sha256_final(const sha256_ctx* ctx, unsigned char* digest);
+
+/*
+ * Hash n independent messages, msgs[i] of lens[i] bytes, writing 32 bytes
+ * to digests[i]. Uses the multi-buffer kernel when it is the best one.
+ */
+void sha256_hash_batch(const unsigned char* const* msgs, const uint64_t* lens, uint64_t n,
+                       unsigned char* const* digests);
+
+/*
+ * Compression function.
+ *
+ * Run nblocks contiguous 64 byte blocks through the SHA-256 compression
+ * function, chaining from state. No padding is applied, so state may hold any
+ * IV or midstate. The fastest kernel for the CPU is picked on first call.
+ */
+void sha256_compress(uint32_t state[8], const unsigned char* blocks, uint64_t nblocks);
+
+/*
+ * Batched compression over n independent states: states[i] absorbs nblocks
+ * contiguous blocks starting at blocks[i].
+ */
+void sha256_compress_batch(uint32_t (*states)[8], const unsigned char* const* blocks,
+                           uint64_t nblocks, uint64_t n);
+
+/*
+ * Kernel selection.
+ *
+ * By default the best kernel for the CPU is used. sha256_set_kernel() forces
+ * one, e.g. to benchmark or cross-check them, and returns -1 if the CPU or the
+ * build lacks it. SHA256_KERNEL_AVX2_X8 only applies to the batch and columnar
+ * entry points; single messages keep the best single-buffer kernel. Set the
+ * kernel before hashing from several threads.
+ */
+typedef enum {
+  SHA256_KERNEL_AUTO = 0,
+  SHA256_KERNEL_SCALAR,
+  SHA256_KERNEL_SHANI,
+  SHA256_KERNEL_AVX2_X8,
+} sha256_kernel;
+
+#define SHA256_NKERNELS 4
+
+int sha256_set_kernel(sha256_kernel k);
+sha256_kernel sha256_get_kernel(void);
+int sha256_kernel_supported(sha256_kernel k);
+const char* sha256_kernel_name(sha256_kernel k);
+
+/*
+ * Autotuning. sha256_autotune() times each kernel per message-size class,
+ * single and batched, and makes SHA256_KERNEL_AUTO follow the winners.
+ * Results are cached in dir (NULL: $XDG_CACHE_HOME or ~/.cache) in a file
+ * keyed by CPU model, so later calls just load it; force reruns the timings.
+ * Takes a few hundred milliseconds when it has to measure. Returns 0, 1 if
+ * the cache could not be written, or -1. Setting SHA256_AUTOTUNE=1 (or to a
+ * directory) does this on first use.
+ */
+int sha256_autotune(const char* dir, int force);
+
+/*
+ * Size recording, available when the library is built with -DSHA256_RECORD.
+ * Set SHA256_RECORD=path (and optionally SHA256_RECORD_RATE=n to sample one
+ * call in n) to record from the first call and write the histogram to path
+ * at exit, or drive it with the functions below.
+ */
+enum {
+  SHA256_API_HASH,        // sha256_hash, sha224_hash
+  SHA256_API_UPDATE,
+  SHA256_API_FINAL,       // total message length
+  SHA256_API_BATCH,       // each message of sha256_hash_batch
+  SHA256_API_COLUMN,      // each row of the column functions
+  SHA256_API_COMPRESS,    // bytes
+  SHA256_API_BATCH_CALL,  // messages per batch or column call
+  SHA256_API_COUNT
+};
+
+int sha256_record_start(const char* path, uint32_t rate);   // path may be NULL
+void sha256_record_stop(void);
+int sha256_record_dump(const char* path);
+
+/*
+ * Latency statistics, available when the library is built with
+ * -DSHA256_STATS. One call in SHA256_STATS_RATE (default 64) per thread is
+ * timed into a histogram keyed by API, size class and kernel. The dump gives
+ * samples and p50/p90/p99/p99.9/max in ns per key; JSON adds the buckets.
+ * Set SHA256_STATS=path to dump at exit (JSON if path ends in .json).
+ */
+int sha256_stats_dump(FILE* f, int json);
+void sha256_stats_reset(void);
+
+/*
+ * Columnar hashing.
+ *
+ * Hash every value of an Arrow-style string column. Row i is the byte range
+ * data[offsets[i]] .. data[offsets[i+1]], so offsets holds nrows+1 entries.
+ * The 32 byte digest of row i is written to digests + 32*i (28 bytes at
+ * digests + 28*i for the sha224_ variants).
+ *
+ * Values are read in place and hashed with SHA-NI when the CPU has it, or fed
+ * straight into the 8-lane AVX2 kernel otherwise; row ranges are spread over
+ * threads when built with OpenMP.
+ */
+void sha256_column(const int32_t* offsets, const unsigned char* data,
+                   uint64_t nrows, unsigned char* digests);
+void sha256_column64(const int64_t* offsets, const unsigned char* data,
+                     uint64_t nrows, unsigned char* digests);
+void sha224_column(const int32_t* offsets, const unsigned char* data,
+                   uint64_t nrows, unsigned char* digests);
+void sha224_column64(const int64_t* offsets, const unsigned char* data,
+                     uint64_t nrows, unsigned char* digests);
+
+#ifdef __cplusplus
+}
+#endif
+
+/*
+ * Header-only mode: define SHA256_HEADER_ONLY before including this file to
+ * get sha256_inline_hash() and the compression kernels as static inline
+ * functions. See sha256_inline.h.
+ */
+#ifdef SHA256_HEADER_ONLY
+#include "sha256_inline.h"
+#endif
+
+#endif /* SHA256_H */
@@ -0,0 +1,270 @@
+/**
+ * sha256.hpp - C++ interface to the SHA-256 implementation.
+ *
+ * sha::sha256_ct("literal") is evaluated entirely at compile time (C++17 and
+ * later). sha::sha256() runs the same constexpr code in constant expressions
+ * and calls the runtime kernels in sha256.c otherwise (C++20, or always the
+ * constexpr code before that).
+ *
+ * sha::Sha256 wraps the streaming C interface: update(), copy() to fork the
+ * midstate, and final() into a sha::Digest, which std::hash understands.
+ */
+#ifndef SHA256_HPP
+#define SHA256_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string_view>
+#include <type_traits>
+#if __has_include(<span>)
+#include <span>
+#endif
+
+#include "sha256.h"
+
+#if defined(__cpp_consteval)
+#define SHA256_CONSTEVAL consteval
+#else
+#define SHA256_CONSTEVAL constexpr
+#endif
+
+namespace sha {
+
+using digest256 = std::array<std::uint8_t, 32>;
+
+namespace ct {
+
+constexpr std::uint32_t rotr(std::uint32_t n, std::uint32_t x) {
+  return (x >> n) | (x << (32-n));
+}
+
+constexpr std::uint32_t ch(std::uint32_t x, std::uint32_t y, std::uint32_t z) {
+  return (x & y) ^ (~x & z);
+}
+
+constexpr std::uint32_t maj(std::uint32_t x, std::uint32_t y, std::uint32_t z) {
+  return (x & y) ^ (x & z) ^ (y & z);
+}
+
+constexpr std::uint32_t Sigma0(std::uint32_t x) {
+  return rotr(2, x) ^ rotr(13, x) ^ rotr(22, x);
+}
+
+constexpr std::uint32_t Sigma1(std::uint32_t x) {
+  return rotr(6, x) ^ rotr(11, x) ^ rotr(25, x);
+}
+
+constexpr std::uint32_t sigma0(std::uint32_t x) {
+  return rotr(7, x) ^ rotr(18, x) ^ (x >> 3);
+}
+
+constexpr std::uint32_t sigma1(std::uint32_t x) {
+  return rotr(17, x) ^ rotr(19, x) ^ (x >> 10);
+}
+
+/* SHA-256 constants */
+inline constexpr std::uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+// Initial hash values.
+inline constexpr std::uint32_t H0[8] = {
+  0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+  0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+// Compress one 64 byte block into H.
+constexpr void compress(std::uint32_t (&H)[8], const std::uint8_t (&blk)[64]) {
+  std::uint32_t W[64] = {};
+
+  // Prepare message schedule.
+  for (int t = 0; t < 64; t++) {
+    if (t < 16) {
+      W[t] = (std::uint32_t(blk[4*t]) << 24) | (std::uint32_t(blk[4*t+1]) << 16) |
+             (std::uint32_t(blk[4*t+2]) << 8) | std::uint32_t(blk[4*t+3]);
+    } else {
+      W[t] = sigma1(W[t-2]) + W[t-7] + sigma0(W[t-15]) + W[t-16];
+    }
+  }
+
+  std::uint32_t a = H[0], b = H[1], c = H[2], d = H[3];
+  std::uint32_t e = H[4], f = H[5], g = H[6], h = H[7];
+
+  for (int t = 0; t < 64; t++) {
+    std::uint32_t T1 = h + Sigma1(e) + ch(e,f,g) + K[t] + W[t];
+    std::uint32_t T2 = Sigma0(a) + maj(a,b,c);
+    h = g;
+    g = f;
+    f = e;
+    e = d + T1;
+    d = c;
+    c = b;
+    b = a;
+    a = T1 + T2;
+  }
+
+  H[0] += a;
+  H[1] += b;
+  H[2] += c;
+  H[3] += d;
+  H[4] += e;
+  H[5] += f;
+  H[6] += g;
+  H[7] += h;
+}
+
+// Hash n bytes of p, where p points to char, unsigned char or std::byte.
+template <class Byte>
+constexpr digest256 hash(const Byte* p, std::size_t n) {
+  std::uint32_t H[8] = {};
+  std::uint8_t blk[64] = {};
+  std::size_t used = 0;
+
+  for (int i = 0; i < 8; i++) {
+    H[i] = H0[i];
+  }
+
+  for (std::size_t i = 0; i < n; i++) {
+    blk[used++] = static_cast<std::uint8_t>(p[i]);
+    if (used == 64) {
+      compress(H, blk);
+      used = 0;
+    }
+  }
+
+  // Pad: '1' bit, zeros, then the 64-bit message length in bits.
+  blk[used++] = 0x80;
+  if (used > 56) {
+    while (used < 64) {
+      blk[used++] = 0;
+    }
+    compress(H, blk);
+    used = 0;
+  }
+  while (used < 56) {
+    blk[used++] = 0;
+  }
+  std::uint64_t bits = std::uint64_t(n) * 8;
+  for (int i = 0; i < 8; i++) {
+    blk[56+i] = static_cast<std::uint8_t>(bits >> (56 - 8*i));
+  }
+  compress(H, blk);
+
+  digest256 out = {};
+  for (int i = 0; i < 8; i++) {
+    out[4*i]   = static_cast<std::uint8_t>(H[i] >> 24);
+    out[4*i+1] = static_cast<std::uint8_t>(H[i] >> 16);
+    out[4*i+2] = static_cast<std::uint8_t>(H[i] >> 8);
+    out[4*i+3] = static_cast<std::uint8_t>(H[i]);
+  }
+  return out;
+}
+
+} // namespace ct
+
+// SHA-256 of a string literal, always computed by the compiler.
+template <std::size_t N>
+SHA256_CONSTEVAL digest256 sha256_ct(const char (&s)[N]) {
+  return ct::hash(s, N - 1);
+}
+
+// SHA-256 of s: constexpr when s is a constant, the fast kernels otherwise.
+constexpr digest256 sha256(std::string_view s) {
+#if defined(__cpp_lib_is_constant_evaluated)
+  if (!std::is_constant_evaluated()) {
+    digest256 out = {};
+    ::sha256_hash(reinterpret_cast<const unsigned char*>(s.data()), s.size(), out.data());
+    return out;
+  }
+#endif
+  return ct::hash(s.data(), s.size());
+}
+
+// A SHA-256 digest. It is a std::array, with equality done as four 64-bit
+// compares instead of a byte loop.
+struct Digest : std::array<std::uint8_t, 32> {
+  friend bool operator==(const Digest& a, const Digest& b) noexcept {
+    std::uint64_t x[4], y[4];
+    std::memcpy(x, a.data(), 32);
+    std::memcpy(y, b.data(), 32);
+    return ((x[0] ^ y[0]) | (x[1] ^ y[1]) | (x[2] ^ y[2]) | (x[3] ^ y[3])) == 0;
+  }
+
+  friend bool operator!=(const Digest& a, const Digest& b) noexcept {
+    return !(a == b);
+  }
+};
+
+// Streaming SHA-256. Move-only, so midstate forks are explicit via copy().
+// Holds no heap memory.
+class Sha256 {
+ public:
+  Sha256() noexcept {
+    sha256_init(&ctx_);
+  }
+
+  Sha256(const Sha256&) = delete;
+  Sha256& operator=(const Sha256&) = delete;
+  Sha256(Sha256&&) noexcept = default;
+  Sha256& operator=(Sha256&&) noexcept = default;
+
+  Sha256& update(const void* data, std::size_t len) noexcept {
+    sha256_update(&ctx_, static_cast<const unsigned char*>(data), len);
+    return *this;
+  }
+
+  Sha256& update(std::string_view s) noexcept {
+    return update(s.data(), s.size());
+  }
+
+#if defined(__cpp_lib_span)
+  Sha256& update(std::span<const std::byte> s) noexcept {
+    return update(s.data(), s.size());
+  }
+#endif
+
+  // Fork the current midstate, e.g. to finish several messages that share
+  // a prefix.
+  Sha256 copy() const noexcept {
+    return Sha256(ctx_);
+  }
+
+  // Digest of everything absorbed so far. The hasher can keep going after.
+  Digest final() const noexcept {
+    Digest d;
+    sha256_final(&ctx_, d.data());
+    return d;
+  }
+
+ private:
+  explicit Sha256(const sha256_ctx& ctx) noexcept : ctx_(ctx) {}
+
+  sha256_ctx ctx_;
+};
+
+} // namespace sha
+
+// Digests are uniformly distributed, so the first 8 bytes make a good hash
+// for unordered containers.
+namespace std {
+template <>
+struct hash<sha::Digest> {
+  size_t operator()(const sha::Digest& d) const noexcept {
+    size_t h;
+    memcpy(&h, d.data(), sizeof(h));
+    return h;
+  }
+};
+} // namespace std
+
+#endif /* SHA256_HPP */
@@ -0,0 +1,290 @@
+/**
+ * sha256_async.hpp - Awaitable SHA-256 for C++20 coroutines.
+ *
+ *   sha::HashPool pool(4);
+ *   sha::AsyncSha256 h(pool, &loop_executor);
+ *   co_await h.update_async(body);      // inline if small, else on the pool
+ *   sha::Digest d = h.final();
+ *
+ * Updates smaller than the pool's adaptive threshold are hashed inline and
+ * never suspend. Larger ones are queued to the pool; a worker drains up to
+ * eight queued updates at once, tops each stream up to a block boundary and
+ * runs the whole blocks of all of them through sha256_compress_batch(), so
+ * many concurrent streams share the multi-buffer kernel. The coroutine is
+ * then resumed through its Executor, or on the worker thread if it has none.
+ *
+ * One stream must not have two updates in flight; awaiting each update
+ * before issuing the next guarantees that.
+ */
+#ifndef SHA256_ASYNC_HPP
+#define SHA256_ASYNC_HPP
+
+#if __cplusplus < 202002L
+#error "sha256_async.hpp needs C++20"
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "sha256.hpp"
+
+namespace sha {
+
+// Where a suspended hashing coroutine resumes, e.g. an event loop's ready
+// queue. post() may be called from any pool thread.
+class Executor {
+ public:
+  virtual ~Executor() = default;
+  virtual void post(std::coroutine_handle<> h) = 0;
+};
+
+class AsyncSha256;
+
+// A queued update: which stream, which bytes, and who to resume after.
+struct HashOp {
+  sha256_ctx* ctx;
+  const unsigned char* data;
+  std::size_t len;
+  std::coroutine_handle<> cont;
+  Executor* executor;
+  std::chrono::steady_clock::time_point queued;
+};
+
+class HashPool {
+ public:
+  // Most updates a worker takes off the queue at once (the AVX2 lane count).
+  static constexpr std::size_t kMaxBatch = 8;
+
+  explicit HashPool(unsigned nthreads = std::max(1u, std::thread::hardware_concurrency())) {
+    for (unsigned i = 0; i < nthreads; i++) {
+      workers_.emplace_back([this] { run(); });
+    }
+  }
+
+  HashPool(const HashPool&) = delete;
+  HashPool& operator=(const HashPool&) = delete;
+
+  ~HashPool() {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& t : workers_) {
+      t.join();
+    }
+  }
+
+  // Updates of at least this many bytes go to the pool.
+  std::size_t threshold() const noexcept {
+    return threshold_.load(std::memory_order_relaxed);
+  }
+
+  void submit(HashOp* op) {
+    op->queued = std::chrono::steady_clock::now();
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      queue_.push_back(op);
+    }
+    cv_.notify_one();
+  }
+
+  // Feed back the cost of an inline update.
+  void record_inline(std::size_t len, std::chrono::nanoseconds t) noexcept {
+    if (len >= 4096) {
+      ewma(ns_per_kib_, double(t.count()) * 1024.0 / double(len));
+      retune();
+    }
+  }
+
+ private:
+  // Offload only when hashing inline would cost several times the hand-off
+  // (queue wait included). The upper clamp bounds how long an inline update
+  // can block the event loop.
+  static constexpr double kOffloadRatio = 4.0;
+  static constexpr std::size_t kMinThreshold = 4096;
+  static constexpr std::size_t kMaxThreshold = std::size_t(1) << 20;
+
+  static void ewma(std::atomic<double>& avg, double sample) noexcept {
+    double old = avg.load(std::memory_order_relaxed);
+    avg.store(old + (sample - old) / 16.0, std::memory_order_relaxed);
+  }
+
+  void retune() noexcept {
+    double bytes = kOffloadRatio * handoff_ns_.load(std::memory_order_relaxed) /
+                   ns_per_kib_.load(std::memory_order_relaxed) * 1024.0;
+    std::size_t t = std::clamp(std::size_t(bytes), kMinThreshold, kMaxThreshold);
+    threshold_.store(t, std::memory_order_relaxed);
+  }
+
+  void run() {
+    std::vector<HashOp*> batch;
+    batch.reserve(kMaxBatch);
+
+    for (;;) {
+      {
+        std::unique_lock<std::mutex> lock(mu_);
+        cv_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+        if (queue_.empty()) {
+          return;
+        }
+        while (!queue_.empty() && batch.size() < kMaxBatch) {
+          batch.push_back(queue_.front());
+          queue_.pop_front();
+        }
+      }
+
+      auto start = std::chrono::steady_clock::now();
+      for (HashOp* op : batch) {
+        ewma(handoff_ns_, double((start - op->queued).count()));
+      }
+      retune();
+
+      hash_batch(batch);
+
+      for (HashOp* op : batch) {
+        if (op->executor != nullptr) {
+          op->executor->post(op->cont);
+        } else {
+          op->cont.resume();
+        }
+      }
+      batch.clear();
+    }
+  }
+
+  // Absorb every op into its stream, sharing compression calls across them.
+  static void hash_batch(const std::vector<HashOp*>& batch) {
+    std::uint32_t states[kMaxBatch][8];
+    const unsigned char* blocks[kMaxBatch];
+    HashOp* lanes[kMaxBatch];
+    std::uint64_t nblocks[kMaxBatch];
+
+    // Bring every stream to a block boundary.
+    for (HashOp* op : batch) {
+      sha256_ctx* ctx = op->ctx;
+      if (ctx->buflen > 0) {
+        std::size_t take = std::min<std::size_t>(64 - ctx->buflen, op->len);
+        sha256_update(ctx, op->data, take);
+        op->data += take;
+        op->len -= take;
+      }
+    }
+
+    // Run the whole blocks of all aligned streams together.
+    for (;;) {
+      std::size_t n = 0;
+      std::uint64_t common = UINT64_MAX;
+      for (HashOp* op : batch) {
+        if (op->ctx->buflen == 0 && op->len >= 64) {
+          lanes[n] = op;
+          nblocks[n] = op->len / 64;
+          common = std::min(common, nblocks[n]);
+          n++;
+        }
+      }
+      if (n == 0) {
+        break;
+      }
+      for (std::size_t i = 0; i < n; i++) {
+        std::copy(lanes[i]->ctx->H, lanes[i]->ctx->H + 8, states[i]);
+        blocks[i] = lanes[i]->data;
+      }
+      sha256_compress_batch(states, blocks, common, n);
+      for (std::size_t i = 0; i < n; i++) {
+        HashOp* op = lanes[i];
+        std::copy(states[i], states[i] + 8, op->ctx->H);
+        op->ctx->len += common * 64;
+        op->data += common * 64;
+        op->len -= common * 64;
+      }
+    }
+
+    // Buffer the partial tails.
+    for (HashOp* op : batch) {
+      sha256_update(op->ctx, op->data, op->len);
+      op->len = 0;
+    }
+  }
+
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::deque<HashOp*> queue_;
+  bool stop_ = false;
+  std::vector<std::thread> workers_;
+
+  std::atomic<std::size_t> threshold_{64 * 1024};
+  std::atomic<double> handoff_ns_{20000.0};
+  std::atomic<double> ns_per_kib_{1000.0};
+};
+
+// Streaming SHA-256 whose updates can be awaited.
+class AsyncSha256 {
+ public:
+  class UpdateAwaitable {
+   public:
+    UpdateAwaitable(AsyncSha256& h, const unsigned char* data, std::size_t len) noexcept
+        : h_(h), op_{&h.ctx_, data, len, {}, h.executor_, {}} {}
+
+    bool await_ready() noexcept {
+      if (op_.len >= h_.pool_.threshold()) {
+        return false;
+      }
+      auto start = std::chrono::steady_clock::now();
+      sha256_update(op_.ctx, op_.data, op_.len);
+      h_.pool_.record_inline(op_.len, std::chrono::steady_clock::now() - start);
+      return true;
+    }
+
+    void await_suspend(std::coroutine_handle<> cont) {
+      op_.cont = cont;
+      h_.pool_.submit(&op_);
+    }
+
+    void await_resume() const noexcept {}
+
+   private:
+    AsyncSha256& h_;
+    HashOp op_;
+  };
+
+  explicit AsyncSha256(HashPool& pool, Executor* executor = nullptr) noexcept
+      : pool_(pool), executor_(executor) {
+    sha256_init(&ctx_);
+  }
+
+  AsyncSha256(const AsyncSha256&) = delete;
+  AsyncSha256& operator=(const AsyncSha256&) = delete;
+
+  UpdateAwaitable update_async(const void* data, std::size_t len) noexcept {
+    return UpdateAwaitable(*this, static_cast<const unsigned char*>(data), len);
+  }
+
+  UpdateAwaitable update_async(std::span<const std::byte> s) noexcept {
+    return update_async(s.data(), s.size());
+  }
+
+  Digest final() const noexcept {
+    Digest d;
+    sha256_final(&ctx_, d.data());
+    return d;
+  }
+
+ private:
+  HashPool& pool_;
+  Executor* executor_;
+  sha256_ctx ctx_;
+};
+
+} // namespace sha
+
+#endif /* SHA256_ASYNC_HPP */
@@ -0,0 +1,243 @@
+/**
+ * sha256_async_test.cpp - Test for sha::HashPool and sha::AsyncSha256.
+ *
+ * Starts many coroutines on one pool. Each feeds its own message through
+ * update_async() in chunks of mixed sizes: empty, sub-block, block multiples,
+ * and sizes on both sides of the pool's adaptive threshold (anything above
+ * its 1 MiB clamp is always offloaded). Every stream's digest is compared
+ * with sha::Sha256 over the same message. Each round runs twice, once with
+ * coroutines resumed on the pool's workers and once through an Executor
+ * drained by the main thread. Concurrent streams land in the same worker
+ * batch, so sha256_compress_batch() runs with several lanes at mixed block
+ * offsets.
+ *
+ *   gcc -O2 -DSHA256_NO_MAIN -c sha256.c
+ *   g++ -std=c++20 -O2 -pthread -o sha256_async_test sha256_async_test.cpp sha256.o
+ *   ./sha256_async_test [-n streams] [-r rounds] [-w workers] [-s seed]
+ */
+#include <unistd.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <vector>
+
+#include "sha256_async.hpp"
+
+namespace {
+
+struct Rng {
+  std::uint64_t s;
+
+  std::uint64_t next() noexcept {
+    s ^= s << 13;
+    s ^= s >> 7;
+    s ^= s << 17;
+    return s;
+  }
+};
+
+// Fire-and-forget coroutine; hash_stream() counts itself out of `left`.
+struct Task {
+  struct promise_type {
+    Task get_return_object() noexcept { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() noexcept {}
+    void unhandled_exception() noexcept { std::terminate(); }
+  };
+};
+
+// Resumes coroutines on whichever thread calls run().
+class LoopExecutor : public sha::Executor {
+ public:
+  void post(std::coroutine_handle<> h) override {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      ready_.push_back(h);
+      posts_++;
+    }
+    cv_.notify_one();
+  }
+
+  // Resume posted coroutines until left reaches zero.
+  void run(std::atomic<int>& left) {
+    for (;;) {
+      std::coroutine_handle<> h;
+      {
+        std::unique_lock<std::mutex> lock(mu_);
+        cv_.wait(lock, [&] { return !ready_.empty() || left.load() == 0; });
+        if (ready_.empty()) {
+          return;
+        }
+        h = ready_.front();
+        ready_.pop_front();
+      }
+      h.resume();
+    }
+  }
+
+  // Wake run() once the last stream has finished.
+  void wake() {
+    std::lock_guard<std::mutex> lock(mu_);
+    cv_.notify_all();
+  }
+
+  std::size_t posts() {
+    std::lock_guard<std::mutex> lock(mu_);
+    return posts_;
+  }
+
+ private:
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::deque<std::coroutine_handle<>> ready_;
+  std::size_t posts_ = 0;
+};
+
+struct Stream {
+  std::vector<unsigned char> msg;
+  std::vector<std::size_t> chunks;
+  sha::Digest got;
+};
+
+std::size_t chunk_len(Rng& rng) {
+  std::uint64_t x = rng.next();
+  switch (x & 7) {
+    case 0: return 0;
+    case 1: return 1 + (x >> 8) % 63;
+    case 2: return 64 * (1 + (x >> 8) % 8);
+    case 3: return 4096 + (x >> 8) % 8192;           // around the minimum threshold
+    case 4: return 60000 + (x >> 8) % 10000;         // around the initial threshold
+    case 5: return (std::size_t(1) << 20) + 1 + (x >> 8) % 4096;   // always offloaded
+    default: return (x >> 8) % 300;
+  }
+}
+
+void make_stream(Rng& rng, Stream& s) {
+  std::size_t n = 1 + rng.next() % 12;
+  std::size_t total = 0;
+
+  s.chunks.clear();
+  for (std::size_t i = 0; i < n; i++) {
+    s.chunks.push_back(chunk_len(rng));
+    total += s.chunks.back();
+  }
+  s.msg.resize(total);
+  for (auto& b : s.msg) {
+    b = (unsigned char)rng.next();
+  }
+}
+
+Task hash_stream(sha::HashPool& pool, sha::Executor* executor, Stream& s,
+                 std::atomic<int>& left, LoopExecutor* loop) {
+  sha::AsyncSha256 h(pool, executor);
+  std::size_t off = 0;
+
+  for (std::size_t len : s.chunks) {
+    co_await h.update_async(s.msg.data() + off, len);
+    off += len;
+  }
+  s.got = h.final();
+  if (left.fetch_sub(1) == 1) {
+    if (loop != nullptr) {
+      loop->wake();
+    } else {
+      left.notify_all();
+    }
+  }
+}
+
+// Hash every stream on the pool, resuming through loop if it is not null.
+// Returns the number of wrong digests.
+int run_round(sha::HashPool& pool, std::vector<Stream>& streams, LoopExecutor* loop) {
+  std::atomic<int> left(int(streams.size()));
+
+  for (auto& s : streams) {
+    hash_stream(pool, loop, s, left, loop);
+  }
+  if (loop != nullptr) {
+    loop->run(left);
+  } else {
+    for (int n = left.load(); n != 0; n = left.load()) {
+      left.wait(n);
+    }
+  }
+
+  int bad = 0;
+  for (std::size_t i = 0; i < streams.size(); i++) {
+    sha::Sha256 want;
+    want.update(streams[i].msg.data(), streams[i].msg.size());
+    if (streams[i].got != want.final()) {
+      std::fprintf(stderr, "stream %zu (%zu bytes in %zu chunks, %s): wrong digest\n", i,
+                   streams[i].msg.size(), streams[i].chunks.size(),
+                   loop != nullptr ? "executor" : "worker");
+      bad++;
+    }
+  }
+  return bad;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  std::size_t nstreams = 48;
+  int rounds = 4;
+  unsigned nworkers = 2;
+  std::uint64_t seed = std::uint64_t(std::time(nullptr));
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:r:w:s:")) != -1) {
+    switch (opt) {
+      case 'n': nstreams = std::strtoull(optarg, nullptr, 10); break;
+      case 'r': rounds = std::atoi(optarg); break;
+      case 'w': nworkers = unsigned(std::atoi(optarg)); break;
+      case 's': seed = std::strtoull(optarg, nullptr, 0); break;
+      default:
+        std::fprintf(stderr, "usage: %s [-n streams] [-r rounds] [-w workers] [-s seed]\n",
+                     argv[0]);
+        return 2;
+    }
+  }
+  if (nworkers < 1) {
+    std::fprintf(stderr, "need at least one worker\n");
+    return 2;
+  }
+
+  // The executor must outlive the pool: a worker can still be inside post()
+  // when the last stream finishes.
+  LoopExecutor loop;
+  sha::HashPool pool(nworkers);
+  std::vector<Stream> streams(nstreams);
+  Rng rng{seed | 1};
+  int bad = 0;
+
+  for (int r = 0; r < rounds; r++) {
+    for (auto& s : streams) {
+      make_stream(rng, s);
+    }
+    bad += run_round(pool, streams, nullptr);
+    bad += run_round(pool, streams, &loop);
+  }
+
+  // Chunks over 1 MiB always go to the pool, so with enough streams some
+  // coroutine must have been resumed through the executor.
+  if (bad == 0 && nstreams >= 8 && loop.posts() == 0) {
+    std::fprintf(stderr, "no update was offloaded to the pool\n");
+    bad++;
+  }
+  if (bad != 0) {
+    return 1;
+  }
+  std::printf("seed %llu: %d rounds of %zu streams on %u workers ok, %zu offloaded "
+              "updates resumed through the executor\n",
+              (unsigned long long)seed, rounds, nstreams, nworkers, loop.posts());
+  return 0;
+}
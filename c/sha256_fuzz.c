@@ -0,0 +1,553 @@
+/**
+ * sha256_fuzz.c - Differential fuzzing of every kernel and API path.
+ *
+ * Each input is hashed with the reference sha256_compute() and then, under
+ * every kernel the CPU supports, through:
+ *
+ *   oneshot   sha256_hash()
+ *   stream    sha256_update() at input-derived boundaries, empty ones included
+ *   batch     sha256_hash_batch() over slices of the input
+ *   column    sha256_column() / sha256_column64() over the same slices
+ *   compress  sha256_compress() over the reference padding
+ *   cbatch    sha256_compress_batch() over 1..17 states with mixed IVs,
+ *             against sha256_compress() per state
+ *   inline    sha256_inline_hash() from the header-only core
+ *   sha224    sha224_hash() / streaming / column against the scalar kernel
+ *   sha512    SHA-512, SHA-384 and SHA-512/256 streaming and batches against
+ *             the one-shot scalar kernel; batches of four or more run the
+ *             AVX2 4-lane kernel when the CPU has it; sha512_compress_batch()
+ *             as for SHA-256
+ *
+ * Any difference aborts with the input, kernel and path, so it works with
+ * libFuzzer, AFL and plain loops alike:
+ *
+ *   clang -g -O1 -fsanitize=fuzzer,address -DSHA256_NO_MAIN -DSHA256_FUZZ_LIBFUZZER \
+ *         -o sha256_fuzz sha256_fuzz.c sha256.c sha512.c
+ *   afl-clang-fast -O2 -DSHA256_NO_MAIN -o sha256_fuzz sha256_fuzz.c sha256.c sha512.c
+ *   afl-fuzz -i seeds -o out -- ./sha256_fuzz -
+ *   gcc -O2 -DSHA256_NO_MAIN -o sha256_fuzz sha256_fuzz.c sha256.c sha512.c
+ *   ./sha256_fuzz [-v sha256_vectors.txt] [-v sha512_vectors.txt] [-t seconds] \
+ *                 [-s seed] [-n max_len]
+ *
+ * The standalone loop first checks the vectors written by
+ * python/gen_vectors.py (SHA-256 from the Python reference, the SHA-512
+ * family from hashlib), then hashes random inputs
+ * until -t seconds pass (0, the default, runs until interrupted), printing a
+ * progress line every ten seconds. "-" reads one input from stdin (AFL).
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SHA256_HEADER_ONLY
+#include "sha256.h"
+#include "sha512.h"
+
+// Longest input the reference checks directly; sha256_compute() allocates
+// every block, so beyond this the scalar kernel stands in for it.
+#define FUZZ_REF_MAX (1 << 16)
+#define FUZZ_MAX_ROWS 24
+
+typedef struct {
+  uint64_t state;
+} fuzz_rng;
+
+// Input-derived choices, so a crashing input replays exactly.
+static uint64_t fuzz_next(fuzz_rng* r) {
+  r->state ^= r->state << 13;
+  r->state ^= r->state >> 7;
+  r->state ^= r->state << 17;
+  return r->state;
+}
+
+static const unsigned char* cur_data;
+static size_t cur_len;
+
+static void fail(const char* kernel, const char* path, uint64_t off, uint64_t len) {
+  fprintf(stderr, "MISMATCH kernel=%s path=%s slice=[%llu, +%llu) input_len=%zu\ninput:",
+          kernel, path, (unsigned long long)off, (unsigned long long)len, cur_len);
+  for (size_t i = 0; i < cur_len && i < 256; i++) {
+    fprintf(stderr, "%02x", cur_data[i]);
+  }
+  fprintf(stderr, "%s\n", cur_len > 256 ? "..." : "");
+  abort();
+}
+
+static void reference(const unsigned char* msg, uint64_t len, unsigned char digest[32]) {
+  if (len > FUZZ_REF_MAX) {
+    sha256_kernel k = sha256_get_kernel();
+    sha256_set_kernel(SHA256_KERNEL_SCALAR);
+    sha256_hash(msg, len, digest);
+    sha256_set_kernel(k);
+    return;
+  }
+  uint64_t n = len, nblks;
+  unsigned char** blks = preprocess_msg((unsigned char*)msg, &n, &nblks);
+  uint32_t* H = sha256_compute(blks, &nblks);
+  for (int i = 0; i < 8; i++) {
+    sha256_store_be32(digest + 4*i, H[i]);
+  }
+  for (uint64_t i = 0; i < nblks; i++) {
+    free(blks[i]);
+  }
+  free(blks);
+}
+
+static void check_stream(const char* kname, const unsigned char* msg, uint64_t len,
+                         fuzz_rng* rng, int sha224, const unsigned char* want) {
+  sha256_ctx ctx;
+  unsigned char got[32];
+  if (sha224) {
+    sha224_init(&ctx);
+  } else {
+    sha256_init(&ctx);
+  }
+  for (uint64_t off = 0; off < len;) {
+    uint64_t r = fuzz_next(rng);
+    // Mostly short pieces, some empty, some spanning many blocks.
+    uint64_t piece = r % 4 == 0 ? 0 : r % 4 == 1 ? (r >> 8) % 70 : (r >> 8) % 700;
+    piece = piece < len - off ? piece : len - off;
+    sha256_update(&ctx, msg + off, piece);
+    off += piece;
+  }
+  sha256_final(&ctx, got);
+  if (memcmp(got, want, sha224 ? 28 : 32) != 0) {
+    fail(kname, sha224 ? "sha224 stream" : "stream", 0, len);
+  }
+}
+
+// Split msg into consecutive rows at input-derived points; returns the count.
+static int split_rows(uint64_t len, fuzz_rng* rng, uint64_t* off) {
+  int n = 1 + (int)(fuzz_next(rng) % FUZZ_MAX_ROWS);
+  off[0] = 0;
+  for (int i = 1; i < n; i++) {
+    off[i] = len ? fuzz_next(rng) % (len + 1) : 0;
+  }
+  off[n] = len;
+  // Insertion sort keeps the rows consecutive; empty rows stay in.
+  for (int i = 1; i < n; i++) {
+    for (int j = i; j > 0 && off[j] < off[j-1]; j--) {
+      uint64_t t = off[j];
+      off[j] = off[j-1];
+      off[j-1] = t;
+    }
+  }
+  return n;
+}
+
+static void check_rows(const char* kname, const unsigned char* msg, uint64_t len,
+                       fuzz_rng* rng) {
+  uint64_t off[FUZZ_MAX_ROWS + 1];
+  int n = split_rows(len, rng, off);
+  unsigned char want[FUZZ_MAX_ROWS][32], want224[FUZZ_MAX_ROWS][28];
+  unsigned char got[FUZZ_MAX_ROWS][32];
+  unsigned char col[FUZZ_MAX_ROWS * 32];
+  const unsigned char* msgs[FUZZ_MAX_ROWS];
+  uint64_t lens[FUZZ_MAX_ROWS];
+  unsigned char* outs[FUZZ_MAX_ROWS];
+  int32_t off32[FUZZ_MAX_ROWS + 1];
+  int64_t off64[FUZZ_MAX_ROWS + 1];
+
+  for (int i = 0; i < n; i++) {
+    msgs[i] = msg + off[i];
+    lens[i] = off[i+1] - off[i];
+    outs[i] = got[i];
+    reference(msgs[i], lens[i], want[i]);
+  }
+  for (int i = 0; i <= n; i++) {
+    off32[i] = (int32_t)off[i];
+    off64[i] = (int64_t)off[i];
+  }
+
+  sha256_hash_batch(msgs, lens, n, outs);
+  for (int i = 0; i < n; i++) {
+    if (memcmp(got[i], want[i], 32) != 0) {
+      fail(kname, "batch", off[i], lens[i]);
+    }
+  }
+  if (len <= INT32_MAX) {
+    sha256_column(off32, msg, n, col);
+    for (int i = 0; i < n; i++) {
+      if (memcmp(col + 32*i, want[i], 32) != 0) {
+        fail(kname, "column", off[i], lens[i]);
+      }
+    }
+  }
+  sha256_column64(off64, msg, n, col);
+  for (int i = 0; i < n; i++) {
+    if (memcmp(col + 32*i, want[i], 32) != 0) {
+      fail(kname, "column64", off[i], lens[i]);
+    }
+  }
+
+  // SHA-224 has no separate reference; the scalar kernel is checked
+  // against sha256_compute() through the shared rounds above.
+  sha256_kernel k = sha256_get_kernel();
+  sha256_set_kernel(SHA256_KERNEL_SCALAR);
+  for (int i = 0; i < n; i++) {
+    sha224_hash(msgs[i], lens[i], want224[i]);
+  }
+  sha256_set_kernel(k);
+  sha224_column64(off64, msg, n, col);
+  for (int i = 0; i < n; i++) {
+    if (memcmp(col + 28*i, want224[i], 28) != 0) {
+      fail(kname, "sha224 column64", off[i], lens[i]);
+    }
+  }
+}
+
+// The SHA-512 family: digest length and entry points of each variant.
+typedef struct {
+  const char* name;
+  int bytes;
+  void (*hash)(const unsigned char*, uint64_t, unsigned char*);
+  void (*init)(sha512_ctx*);
+  void (*batch)(const unsigned char* const*, const uint64_t*, uint64_t, unsigned char* const*);
+} fuzz_sha512;
+
+static const fuzz_sha512 fuzz_sha512_variants[3] = {
+  { "sha512", 64, sha512_hash, sha512_init, sha512_hash_batch },
+  { "sha384", 48, sha384_hash, sha384_init, sha384_hash_batch },
+  { "sha512_256", 32, sha512_256_hash, sha512_256_init, sha512_256_hash_batch },
+};
+
+// Streaming and batches against the scalar one-shot hash of each slice. A
+// batch of four or more rows goes through the AVX2 kernel, so this is also
+// the scalar-versus-AVX2 cross-check.
+static void check_sha512(const fuzz_sha512* f, const unsigned char* msg, uint64_t len,
+                         fuzz_rng* rng) {
+  unsigned char want[64], got[64];
+  f->hash(msg, len, want);
+
+  sha512_ctx ctx;
+  f->init(&ctx);
+  for (uint64_t off = 0; off < len;) {
+    uint64_t r = fuzz_next(rng);
+    uint64_t piece = r % 4 == 0 ? 0 : r % 4 == 1 ? (r >> 8) % 140 : (r >> 8) % 1400;
+    piece = piece < len - off ? piece : len - off;
+    sha512_update(&ctx, msg + off, piece);
+    off += piece;
+  }
+  sha512_final(&ctx, got);
+  if (memcmp(got, want, f->bytes) != 0) {
+    fail(f->name, "stream", 0, len);
+  }
+
+  uint64_t off[FUZZ_MAX_ROWS + 1];
+  int n = split_rows(len, rng, off);
+  const unsigned char* msgs[FUZZ_MAX_ROWS];
+  uint64_t lens[FUZZ_MAX_ROWS];
+  unsigned char out[FUZZ_MAX_ROWS][64];
+  unsigned char* outs[FUZZ_MAX_ROWS];
+  for (int i = 0; i < n; i++) {
+    msgs[i] = msg + off[i];
+    lens[i] = off[i+1] - off[i];
+    outs[i] = out[i];
+  }
+  f->batch(msgs, lens, n, outs);
+  for (int i = 0; i < n; i++) {
+    f->hash(msgs[i], lens[i], want);
+    if (memcmp(out[i], want, f->bytes) != 0) {
+      fail(f->name, "batch", off[i], lens[i]);
+    }
+  }
+}
+
+static void check_compress(const char* kname, const unsigned char* msg, uint64_t len,
+                           const unsigned char* want) {
+  if (len > FUZZ_REF_MAX) {
+    return;
+  }
+  uint64_t n = len, bits;
+  unsigned char* padded = padmsg((unsigned char*)msg, &n, &bits);
+  uint32_t H[8];
+  unsigned char got[32];
+  memcpy(H, sha256_H0, sizeof(H));
+  sha256_compress(H, padded, bits / 512);
+  for (int i = 0; i < 8; i++) {
+    sha256_store_be32(got + 4*i, H[i]);
+  }
+  free(padded);
+  if (memcmp(got, want, 32) != 0) {
+    fail(kname, "compress", 0, len);
+  }
+}
+
+#define FUZZ_MAX_STATES 17
+
+// Starting states for compress_batch: the IV, or input-derived words.
+static void fuzz_states(fuzz_rng* rng, int n, uint64_t (*states)[8], const uint64_t* iv) {
+  for (int i = 0; i < n; i++) {
+    int random = fuzz_next(rng) % 2;
+    for (int w = 0; w < 8; w++) {
+      states[i][w] = random ? fuzz_next(rng) : iv[w];
+    }
+  }
+}
+
+// n states each absorb the same number of whole blocks of msg, from
+// input-derived offsets; the batch must match compressing them one by one.
+static void check_compress_batch(const char* kname, const unsigned char* msg, uint64_t len,
+                                 fuzz_rng* rng) {
+  uint64_t seed[FUZZ_MAX_STATES][8], iv[8];
+  uint32_t want[FUZZ_MAX_STATES][8], got[FUZZ_MAX_STATES][8];
+  const unsigned char* blocks[FUZZ_MAX_STATES];
+  int n = 1 + (int)(fuzz_next(rng) % FUZZ_MAX_STATES);
+  uint64_t nblocks = fuzz_next(rng) % (len / 64 + 1);
+
+  for (int w = 0; w < 8; w++) {
+    iv[w] = sha256_H0[w];
+  }
+  fuzz_states(rng, n, seed, iv);
+  for (int i = 0; i < n; i++) {
+    blocks[i] = msg + fuzz_next(rng) % (len - 64*nblocks + 1);
+    for (int w = 0; w < 8; w++) {
+      want[i][w] = got[i][w] = (uint32_t)seed[i][w];
+    }
+    sha256_compress(want[i], blocks[i], nblocks);
+  }
+  sha256_compress_batch(got, blocks, nblocks, n);
+  for (int i = 0; i < n; i++) {
+    if (memcmp(got[i], want[i], sizeof(want[i])) != 0) {
+      fail(kname, "cbatch", blocks[i] - msg, 64*nblocks);
+    }
+  }
+}
+
+static void check_sha512_compress_batch(const unsigned char* msg, uint64_t len, fuzz_rng* rng) {
+  static const uint64_t iv[8] = {
+    0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+    0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL,
+  };
+  uint64_t want[FUZZ_MAX_STATES][8], got[FUZZ_MAX_STATES][8];
+  const unsigned char* blocks[FUZZ_MAX_STATES];
+  int n = 1 + (int)(fuzz_next(rng) % FUZZ_MAX_STATES);
+  uint64_t nblocks = fuzz_next(rng) % (len / 128 + 1);
+
+  fuzz_states(rng, n, got, iv);
+  for (int i = 0; i < n; i++) {
+    blocks[i] = msg + fuzz_next(rng) % (len - 128*nblocks + 1);
+    memcpy(want[i], got[i], sizeof(want[i]));
+    sha512_compress(want[i], blocks[i], nblocks);
+  }
+  sha512_compress_batch(got, blocks, nblocks, n);
+  for (int i = 0; i < n; i++) {
+    if (memcmp(got[i], want[i], sizeof(want[i])) != 0) {
+      fail("sha512", "cbatch", blocks[i] - msg, 128*nblocks);
+    }
+  }
+}
+
+static int fuzz_one(const unsigned char* data, size_t size) {
+  unsigned char want[32], want224[28], got[32];
+  uint64_t seed = 0x9E3779B97F4A7C15ULL;
+
+  cur_data = data;
+  cur_len = size;
+  for (size_t i = 0; i < size && i < 64; i++) {
+    seed = (seed ^ data[i]) * 0x100000001B3ULL;
+  }
+  fuzz_rng rng = { seed | 1 };
+
+  reference(data, size, want);
+  sha256_set_kernel(SHA256_KERNEL_SCALAR);
+  sha224_hash(data, size, want224);
+
+  sha256_inline_hash(data, size, got);
+  if (memcmp(got, want, 32) != 0) {
+    fail("inline", "inline", 0, size);
+  }
+
+  for (int k = SHA256_KERNEL_AUTO; k < SHA256_NKERNELS; k++) {
+    if (sha256_set_kernel((sha256_kernel)k) != 0) {
+      continue;
+    }
+    const char* kname = sha256_kernel_name((sha256_kernel)k);
+
+    sha256_hash(data, size, got);
+    if (memcmp(got, want, 32) != 0) {
+      fail(kname, "oneshot", 0, size);
+    }
+    sha224_hash(data, size, got);
+    if (memcmp(got, want224, 28) != 0) {
+      fail(kname, "sha224", 0, size);
+    }
+    check_stream(kname, data, size, &rng, 0, want);
+    check_stream(kname, data, size, &rng, 1, want224);
+    check_rows(kname, data, size, &rng);
+    check_compress(kname, data, size, want);
+    check_compress_batch(kname, data, size, &rng);
+  }
+  sha256_set_kernel(SHA256_KERNEL_AUTO);
+
+  for (int v = 0; v < 3; v++) {
+    check_sha512(&fuzz_sha512_variants[v], data, size, &rng);
+  }
+  check_sha512_compress_batch(data, size, &rng);
+  return 0;
+}
+
+#ifdef SHA256_FUZZ_LIBFUZZER
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  return fuzz_one(data, size);
+}
+#else
+
+// Message bytes of python/gen_vectors.py: the top byte of a 32-bit LCG.
+static void vector_message(unsigned char* out, uint64_t len, uint32_t seed) {
+  uint32_t x = seed;
+  for (uint64_t i = 0; i < len; i++) {
+    x = x * 1103515245u + 12345u;
+    out[i] = (unsigned char)(x >> 24);
+  }
+}
+
+static void parse_hex(const char* hex, unsigned char* out, int bytes) {
+  for (int i = 0; i < bytes; i++) {
+    unsigned int b;
+    sscanf(hex + 2*i, "%2x", &b);
+    out[i] = (unsigned char)b;
+  }
+}
+
+// "len seed sha512 sha384 sha512_256", checked through every SHA-512 path.
+static void check_vector_sha512(const unsigned char* msg, uint64_t len, char hex[3][129]) {
+  for (int v = 0; v < 3; v++) {
+    const fuzz_sha512* f = &fuzz_sha512_variants[v];
+    unsigned char want[64], got[64];
+    parse_hex(hex[v], want, f->bytes);
+    f->hash(msg, len, got);
+    if (memcmp(got, want, f->bytes) != 0) {
+      fail(f->name, "vector", 0, len);
+    }
+  }
+}
+
+// SHA-256 files have one digest per line, SHA-512 ones three.
+static int check_vectors(const char* path) {
+  char line[512];
+  int n = 0;
+  FILE* f = fopen(path, "r");
+  if (f == NULL) {
+    perror(path);
+    return -1;
+  }
+  while (fgets(line, sizeof(line), f) != NULL) {
+    unsigned long long len;
+    unsigned long seed;
+    char hex[3][129];
+    int fields = line[0] == '#' ? 0 : sscanf(line, "%llu %lu %128s %128s %128s", &len, &seed,
+                                             hex[0], hex[1], hex[2]);
+    if (fields != 3 && fields != 5) {
+      continue;
+    }
+    unsigned char* msg = malloc(len + 1);
+    vector_message(msg, len, (uint32_t)seed);
+    cur_data = msg;
+    cur_len = len;
+    if (fields == 5) {
+      check_vector_sha512(msg, len, hex);
+    } else {
+      unsigned char want[32], got[32];
+      parse_hex(hex[0], want, 32);
+      // The C reference has to agree with the Python one before it judges.
+      reference(msg, len, got);
+      if (memcmp(got, want, 32) != 0) {
+        fail("reference", "vector", 0, len);
+      }
+    }
+    fuzz_one(msg, len);
+    free(msg);
+    n++;
+  }
+  fclose(f);
+  printf("%d vectors ok\n", n);
+  return 0;
+}
+
+static uint64_t now_s(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec;
+}
+
+int main(int argc, char** argv) {
+  const char* vectors[4];
+  int nvectors = 0;
+  uint64_t secs = 0, seed = (uint64_t)time(NULL), max_len = 4096;
+  int opt;
+
+  if (argc == 2 && strcmp(argv[1], "-") == 0) {
+    static unsigned char buf[1 << 20];
+#ifdef __AFL_LOOP
+    while (__AFL_LOOP(10000)) {
+#endif
+      size_t n = fread(buf, 1, sizeof(buf), stdin);
+      fuzz_one(buf, n);
+#ifdef __AFL_LOOP
+    }
+#endif
+    return 0;
+  }
+
+  while ((opt = getopt(argc, argv, "v:t:s:n:")) != -1) {
+    switch (opt) {
+      case 'v':
+        if (nvectors == 4) {
+          fprintf(stderr, "at most 4 -v files\n");
+          return 2;
+        }
+        vectors[nvectors++] = optarg;
+        break;
+      case 't': secs = strtoull(optarg, NULL, 10); break;
+      case 's': seed = strtoull(optarg, NULL, 0); break;
+      case 'n': max_len = strtoull(optarg, NULL, 0); break;
+      default:
+        fprintf(stderr, "usage: %s [-v vectors] [-t seconds] [-s seed] [-n max_len] | -\n",
+                argv[0]);
+        return 2;
+    }
+  }
+
+  for (int i = 0; i < nvectors; i++) {
+    if (check_vectors(vectors[i]) != 0) {
+      return 1;
+    }
+  }
+
+  printf("seed %llu, inputs up to %llu bytes\n", (unsigned long long)seed,
+         (unsigned long long)max_len);
+  fflush(stdout);
+  fuzz_rng rng = { seed | 1 };
+  unsigned char* buf = malloc(max_len + 1);
+  uint64_t start = now_s(), last = start, iters = 0;
+  for (;;) {
+    // Favour short inputs, where the padding cases are.
+    uint64_t r = fuzz_next(&rng);
+    uint64_t len = r % 3 ? (r >> 8) % (max_len < 300 ? max_len + 1 : 300)
+                         : (r >> 8) % (max_len + 1);
+    for (uint64_t i = 0; i < len; i++) {
+      buf[i] = (unsigned char)fuzz_next(&rng);
+    }
+    fuzz_one(buf, len);
+    iters++;
+
+    uint64_t t = now_s();
+    if (t - last >= 10) {
+      printf("%llu s: %llu inputs ok\n", (unsigned long long)(t - start),
+             (unsigned long long)iters);
+      fflush(stdout);
+      last = t;
+    }
+    if (secs != 0 && t - start >= secs) {
+      break;
+    }
+  }
+  printf("%llu inputs ok\n", (unsigned long long)iters);
+  free(buf);
+  return 0;
+}
+#endif /* SHA256_FUZZ_LIBFUZZER */
@@ -0,0 +1,197 @@
+/**
+ * sha256_inline.h - Inlinable SHA-256 core.
+ *
+ * The portable and SHA-NI compression kernels, tail padding and a one-shot
+ * hash for short messages, all static inline. The portable kernel and the
+ * padding are the 32-bit instance of sha2_engine.h. sha256.c builds on these, and
+ * defining SHA256_HEADER_ONLY before including sha256.h pulls them into the
+ * caller so that short-key hashing inlines into hash-table code:
+ *
+ *   #define SHA256_HEADER_ONLY
+ *   #include "sha256.h"
+ *   ...
+ *   sha256_inline_hash(key, keylen, digest);
+ *
+ * The SHA-NI kernel is inlined when the compiler targets it (-msha, or
+ * -march=native on a CPU that has it). Otherwise a CPUID check, cached per
+ * translation unit, calls it out of line when the CPU has SHA-NI, so the
+ * default build does not fall back to the much slower portable kernel.
+ * Defining SHA256_LINK_KERNELS as well
+ * sends messages longer than SHA256_INLINE_MAX to the out-of-line
+ * sha256_hash(), which needs sha256.c linked in.
+ */
+#ifndef SHA256_INLINE_H
+#define SHA256_INLINE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "sha2_engine.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SHA256_HAVE_SHANI 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#ifndef SHA256_INLINE_MAX
+#define SHA256_INLINE_MAX 256
+#endif
+
+#define SHA256_ROTR(x, n) (((x) >> (n)) | ((x) << (32-(n))))
+#define SHA256_CH(x, y, z) (((x) & (y)) ^ (~(x) & (z)))
+#define SHA256_MAJ(x, y, z) (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+#define SHA256_BSIG0(x) (SHA256_ROTR(x, 2) ^ SHA256_ROTR(x, 13) ^ SHA256_ROTR(x, 22))
+#define SHA256_BSIG1(x) (SHA256_ROTR(x, 6) ^ SHA256_ROTR(x, 11) ^ SHA256_ROTR(x, 25))
+#define SHA256_SSIG0(x) (SHA256_ROTR(x, 7) ^ SHA256_ROTR(x, 18) ^ ((x) >> 3))
+#define SHA256_SSIG1(x) (SHA256_ROTR(x, 17) ^ SHA256_ROTR(x, 19) ^ ((x) >> 10))
+
+/* SHA-256 constants */
+static const uint32_t sha256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+// Initial hash values.
+static const uint32_t sha256_H0[8] = {
+  0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+  0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+static inline uint32_t sha256_load_be32(const unsigned char* p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline void sha256_store_be32(unsigned char* p, uint32_t x) {
+  p[0] = x >> 24;
+  p[1] = x >> 16;
+  p[2] = x >> 8;
+  p[3] = x;
+}
+
+// Portable kernel: compress nblks contiguous 64 byte blocks into H.
+SHA2_DEFINE_BLOCKS_SCALAR(sha256_blocks_scalar, uint32_t, 64, sha256_K, sha256_load_be32,
+                          SHA256_BSIG0, SHA256_BSIG1, SHA256_SSIG0, SHA256_SSIG1,
+                          SHA256_CH, SHA256_MAJ)
+
+// Build the padded final block(s) of a len byte message whose trailing
+// (len % 64) bytes start at rem. Returns the number of blocks, 1 or 2.
+SHA2_DEFINE_PAD_TAIL(sha256_pad_tail, 64, 8)
+
+#ifdef SHA256_HAVE_SHANI
+/*
+ * SHA-NI kernel.
+ *
+ * The SHA extensions keep the state as two vectors, ABEF and CDGH, and each
+ * sha256rnds2 performs two rounds. Message words are scheduled four at a time
+ * with sha256msg1/sha256msg2, three groups ahead of the rounds using them.
+ */
+__attribute__((target("sha,sse4.1")))
+static inline void sha256_blocks_shani(uint32_t H[8], const unsigned char* blks, uint64_t nblks) {
+  const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+  __m128i STATE0, STATE1, ABEF, CDGH, MSG, TMP;
+  __m128i M[4];
+
+  TMP = _mm_loadu_si128((const __m128i*)&H[0]);      // DCBA
+  STATE1 = _mm_loadu_si128((const __m128i*)&H[4]);   // HGFE
+  TMP = _mm_shuffle_epi32(TMP, 0xB1);                // CDAB
+  STATE1 = _mm_shuffle_epi32(STATE1, 0x1B);          // EFGH
+  STATE0 = _mm_alignr_epi8(TMP, STATE1, 8);          // ABEF
+  STATE1 = _mm_blend_epi16(STATE1, TMP, 0xF0);       // CDGH
+
+  for (uint64_t i = 0; i < nblks; i++, blks += 64) {
+    ABEF = STATE0;
+    CDGH = STATE1;
+
+#pragma GCC unroll 16
+    for (int g = 0; g < 16; g++) {
+      __m128i* cur = &M[g & 3];
+      __m128i* prev = &M[(g-1) & 3];
+      __m128i* next = &M[(g+1) & 3];
+
+      if (g < 4) {
+        *cur = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(blks + 16*g)), bswap);
+      }
+      MSG = _mm_add_epi32(*cur, _mm_loadu_si128((const __m128i*)&sha256_K[4*g]));
+      STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG);
+      if (g >= 3 && g <= 14) {
+        TMP = _mm_alignr_epi8(*cur, *prev, 4);
+        *next = _mm_sha256msg2_epu32(_mm_add_epi32(*next, TMP), *cur);
+      }
+      MSG = _mm_shuffle_epi32(MSG, 0x0E);
+      STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG);
+      if (g >= 1 && g <= 12) {
+        *prev = _mm_sha256msg1_epu32(*prev, *cur);
+      }
+    }
+
+    STATE0 = _mm_add_epi32(STATE0, ABEF);
+    STATE1 = _mm_add_epi32(STATE1, CDGH);
+  }
+
+  TMP = _mm_shuffle_epi32(STATE0, 0x1B);             // FEBA
+  STATE1 = _mm_shuffle_epi32(STATE1, 0xB1);          // DCHG
+  STATE0 = _mm_blend_epi16(TMP, STATE1, 0xF0);       // DCBA
+  STATE1 = _mm_alignr_epi8(STATE1, TMP, 8);          // HGFE
+  _mm_storeu_si128((__m128i*)&H[0], STATE0);
+  _mm_storeu_si128((__m128i*)&H[4], STATE1);
+}
+#endif /* SHA256_HAVE_SHANI */
+
+#if defined(SHA256_HAVE_SHANI) && defined(__SHA__) && defined(__SSE4_1__)
+#define sha256_inline_compress sha256_blocks_shani
+#elif defined(SHA256_HAVE_SHANI)
+static inline int sha256_inline_has_shani(void) {
+  static int has = -1;
+  int h = __atomic_load_n(&has, __ATOMIC_RELAXED);
+  if (__builtin_expect(h < 0, 0)) {
+    unsigned int a, b, c, d;
+    h = __get_cpuid(1, &a, &b, &c, &d) && (c & bit_SSE4_1) &&
+        __get_cpuid_count(7, 0, &a, &b, &c, &d) && (b & bit_SHA);
+    __atomic_store_n(&has, h, __ATOMIC_RELAXED);
+  }
+  return h;
+}
+
+// Not built for SHA-NI: the kernel cannot inline here, but a call to it
+// still beats the portable kernel by several times.
+static inline void sha256_inline_compress(uint32_t H[8], const unsigned char* blks,
+                                          uint64_t nblks) {
+  if (__builtin_expect(sha256_inline_has_shani(), 1)) {
+    sha256_blocks_shani(H, blks, nblks);
+  } else {
+    sha256_blocks_scalar(H, blks, nblks);
+  }
+}
+#else
+#define sha256_inline_compress sha256_blocks_scalar
+#endif
+
+static inline void sha256_inline_hash(const unsigned char* msg, uint64_t len, unsigned char digest[32]) {
+  uint32_t H[8];
+  unsigned char tail[128];
+
+#ifdef SHA256_LINK_KERNELS
+  if (len > SHA256_INLINE_MAX) {
+    sha256_hash(msg, len, digest);
+    return;
+  }
+#endif
+
+  memcpy(H, sha256_H0, sizeof(H));
+  sha256_inline_compress(H, msg, len / 64);
+  int ntail = sha256_pad_tail(tail, msg + (len - len % 64), len);
+  sha256_inline_compress(H, tail, ntail);
+
+  for (int i = 0; i < 8; i++) {
+    sha256_store_be32(digest + 4*i, H[i]);
+  }
+}
+
+#endif /* SHA256_INLINE_H */
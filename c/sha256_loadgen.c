@@ -0,0 +1,296 @@
+/**
+ * sha256_loadgen.c - Open-loop load generator for sha256_sockd.
+ *
+ * For each target rate, every connection sends requests on a fixed schedule
+ * and a second thread collects the responses. Latency is measured from the
+ * time a request was scheduled, not when it was actually sent, so a daemon
+ * that falls behind (and pushes back through the socket) shows up in the
+ * tail instead of silently lowering the offered load.
+ *
+ *   gcc -O2 -pthread -DSHA256_NO_MAIN -o sha256_loadgen sha256_loadgen.c sha256.c
+ *   ./sha256_loadgen [-s path] [-c conns] [-p payload] [-f file] [-t secs] \
+ *                    [-q qps,qps,...]
+ *
+ * With -f, each request passes the file's descriptor instead of an inline
+ * payload. Every digest is checked.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sha256.h"
+#include "sha256_sock.h"
+
+typedef struct {
+  int sock;
+  uint64_t n;               // requests to send
+  uint64_t interval_ns;
+  uint64_t start_ns;
+  uint64_t* sched;          // scheduled send time per id
+  uint64_t* lat;            // latency per id
+  uint64_t errors;
+} conn;
+
+static const char* sock_path = SHA256_SOCK_PATH;
+static unsigned char* payload;
+static uint64_t payload_len;
+static int file_fd = -1;
+static unsigned char expected[32];
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int connect_daemon(void) {
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  strncpy(addr.sun_path, sock_path, sizeof(addr.sun_path) - 1);
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd >= 0 && connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+    close(fd);
+    fd = -1;
+  }
+  return fd;
+}
+
+static int send_all(int fd, const void* p, size_t len) {
+  while (len > 0) {
+    ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    p = (const char*)p + n;
+    len -= n;
+  }
+  return 0;
+}
+
+static int send_request(conn* c, uint64_t id) {
+  sha256_sock_req h = { .id = id };
+
+  if (file_fd < 0) {
+    h.type = SHA256_SOCK_INLINE;
+    h.len = payload_len;
+    if (send_all(c->sock, &h, sizeof(h)) != 0) {
+      return -1;
+    }
+    return send_all(c->sock, payload, payload_len);
+  }
+
+  union {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(sizeof(int))];
+  } ctl;
+  struct iovec iov = { &h, sizeof(h) };
+  struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1,
+                        .msg_control = ctl.buf, .msg_controllen = sizeof(ctl.buf) };
+  struct cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+  cm->cmsg_level = SOL_SOCKET;
+  cm->cmsg_type = SCM_RIGHTS;
+  cm->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cm), &file_fd, sizeof(int));
+
+  h.type = SHA256_SOCK_FD;
+  ssize_t n;
+  do {
+    n = sendmsg(c->sock, &msg, MSG_NOSIGNAL);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0) {
+    return -1;
+  }
+  // The descriptor went with the first byte; send the rest plainly.
+  return send_all(c->sock, (char*)&h + n, sizeof(h) - n);
+}
+
+static void* sender(void* arg) {
+  conn* c = arg;
+
+  for (uint64_t i = 0; i < c->n; i++) {
+    uint64_t t = c->start_ns + i * c->interval_ns;
+    if (now_ns() < t) {
+      struct timespec ts = { t / 1000000000ULL, t % 1000000000ULL };
+      clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+    }
+    __atomic_store_n(&c->sched[i], t, __ATOMIC_RELEASE);
+    if (send_request(c, i) != 0) {
+      perror("send");
+      break;
+    }
+  }
+  return NULL;
+}
+
+static void* receiver(void* arg) {
+  conn* c = arg;
+  sha256_sock_resp r;
+
+  for (uint64_t got = 0; got < c->n; got++) {
+    size_t have = 0;
+    while (have < sizeof(r)) {
+      ssize_t n = recv(c->sock, (char*)&r + have, sizeof(r) - have, 0);
+      if (n <= 0) {
+        if (n < 0 && errno == EINTR) {
+          continue;
+        }
+        c->errors += c->n - got;
+        return NULL;
+      }
+      have += n;
+    }
+    uint64_t t = now_ns();
+    if (r.id >= c->n || r.status != SHA256_SOCK_OK || memcmp(r.digest, expected, 32) != 0) {
+      c->errors++;
+      continue;
+    }
+    c->lat[r.id] = t - __atomic_load_n(&c->sched[r.id], __ATOMIC_ACQUIRE);
+  }
+  return NULL;
+}
+
+static int cmp_u64(const void* a, const void* b) {
+  uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+  return (x > y) - (x < y);
+}
+
+static double percentile_us(const uint64_t* sorted, uint64_t n, double p) {
+  if (n == 0) {
+    return 0;
+  }
+  uint64_t i = (uint64_t)(p * (n - 1) + 0.5);
+  return sorted[i] / 1e3;
+}
+
+// Offer qps requests per second for secs seconds, spread over nconn
+// connections, and print one line of results.
+static int run_step(double qps, int nconn, double secs) {
+  conn* cs = calloc(nconn, sizeof(conn));
+  pthread_t* th = calloc(2 * nconn, sizeof(pthread_t));
+  uint64_t per_conn = (uint64_t)(qps * secs / nconn);
+  uint64_t start = now_ns() + 10000000;   // 10 ms to set up
+
+  if (per_conn == 0) {
+    per_conn = 1;
+  }
+  for (int i = 0; i < nconn; i++) {
+    conn* c = &cs[i];
+    c->sock = connect_daemon();
+    if (c->sock < 0) {
+      perror("connect");
+      return -1;
+    }
+    c->n = per_conn;
+    c->interval_ns = (uint64_t)(1e9 * nconn / qps);
+    // Stagger the connections across one interval.
+    c->start_ns = start + c->interval_ns * i / nconn;
+    c->sched = calloc(per_conn, sizeof(uint64_t));
+    c->lat = calloc(per_conn, sizeof(uint64_t));
+  }
+  for (int i = 0; i < nconn; i++) {
+    pthread_create(&th[2 * i], NULL, receiver, &cs[i]);
+    pthread_create(&th[2 * i + 1], NULL, sender, &cs[i]);
+  }
+  for (int i = 0; i < 2 * nconn; i++) {
+    pthread_join(th[i], NULL);
+  }
+  uint64_t elapsed = now_ns() - start;
+
+  uint64_t total = per_conn * nconn, errors = 0, n = 0;
+  uint64_t* all = malloc(total * sizeof(uint64_t));
+  for (int i = 0; i < nconn; i++) {
+    errors += cs[i].errors;
+    for (uint64_t j = 0; j < per_conn; j++) {
+      if (cs[i].lat[j] != 0) {
+        all[n++] = cs[i].lat[j];
+      }
+    }
+    close(cs[i].sock);
+    free(cs[i].sched);
+    free(cs[i].lat);
+  }
+  qsort(all, n, sizeof(uint64_t), cmp_u64);
+
+  printf("%10.0f %10.0f %10.1f %10.1f %10.1f %10.1f %8llu\n", qps, n / (elapsed / 1e9),
+         percentile_us(all, n, 0.50), percentile_us(all, n, 0.99), percentile_us(all, n, 0.999),
+         n ? all[n - 1] / 1e3 : 0.0, (unsigned long long)errors);
+  fflush(stdout);
+
+  free(all);
+  free(th);
+  free(cs);
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  int nconn = 4;
+  double secs = 2;
+  const char* rates = "1000,10000,50000,100000";
+  const char* file = NULL;
+  int opt;
+
+  payload_len = 64;
+  while ((opt = getopt(argc, argv, "s:c:p:f:t:q:")) != -1) {
+    switch (opt) {
+      case 's': sock_path = optarg; break;
+      case 'c': nconn = atoi(optarg); break;
+      case 'p': payload_len = strtoull(optarg, NULL, 10); break;
+      case 'f': file = optarg; break;
+      case 't': secs = atof(optarg); break;
+      case 'q': rates = optarg; break;
+      default:
+        fprintf(stderr, "usage: %s [-s path] [-c conns] [-p payload] [-f file] [-t secs] "
+                "[-q qps,...]\n", argv[0]);
+        return 2;
+    }
+  }
+  if (nconn < 1) {
+    nconn = 1;
+  }
+
+  if (file != NULL) {
+    struct stat st;
+    file_fd = open(file, O_RDONLY | O_CLOEXEC);
+    if (file_fd < 0 || fstat(file_fd, &st) != 0) {
+      perror(file);
+      return 1;
+    }
+    payload_len = st.st_size;
+    payload = malloc(payload_len + 1);
+    if (pread(file_fd, payload, payload_len, 0) != (ssize_t)payload_len) {
+      perror(file);
+      return 1;
+    }
+  } else {
+    payload = malloc(payload_len + 1);
+    for (uint64_t i = 0; i < payload_len; i++) {
+      payload[i] = (unsigned char)(i * 131 + 7);
+    }
+  }
+  sha256_hash(payload, payload_len, expected);
+
+  printf("%s payload %llu bytes, %d connections, %.1f s per step\n",
+         file_fd < 0 ? "inline" : "fd", (unsigned long long)payload_len, nconn, secs);
+  printf("%10s %10s %10s %10s %10s %10s %8s\n", "target", "achieved", "p50 us", "p99 us",
+         "p99.9 us", "max us", "errors");
+
+  char* list = strdup(rates);
+  for (char* tok = strtok(list, ","); tok != NULL; tok = strtok(NULL, ",")) {
+    if (run_step(atof(tok), nconn, secs) != 0) {
+      return 1;
+    }
+  }
+  free(list);
+  return 0;
+}
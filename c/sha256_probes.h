@@ -0,0 +1,44 @@
+/**
+ * sha256_probes.h - USDT static probes for sha256.c.
+ *
+ * With <sys/sdt.h> available (systemtap-sdt-dev / systemtap-sdt-devel),
+ * each probe compiles to a single nop plus an ELF note naming its
+ * arguments, so tracers can attach to a running process. The arguments are
+ * values the code has already computed (the kernel it picked, the lane
+ * count it chose), so an idle probe adds no work beyond the nop:
+ *
+ *   bpftrace -e 'usdt:./libsha256.so:sha256:hash__done { @[arg1] = hist(arg0); }'
+ *
+ * Probes (provider "sha256"):
+ *   hash__start(len, kernel)          sha256_hash / sha224_hash entry
+ *   hash__done(len, kernel)           ... and return
+ *   batch__dispatch(nmsgs, lanes)     each range of rows handed to a kernel:
+ *                                     the whole sha256_hash_batch() call, or
+ *                                     each 4096-row chunk of a column call
+ *   kernel__select(requested, kernel, lanes)
+ *
+ * kernel is a sha256_kernel value for the kernel that actually runs; lanes
+ * is 8 when independent messages go through the AVX2 x8 kernel, else 1.
+ * kernel__select reports the choice for the largest messages when the
+ * autotuner picks per size.
+ * Without the header, or with -DSHA256_NO_PROBES, the probes vanish.
+ */
+#ifndef SHA256_PROBES_H
+#define SHA256_PROBES_H
+
+#if !defined(SHA256_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define SHA256_PROBES 1
+#endif
+#endif
+
+#ifdef SHA256_PROBES
+#define SHA256_PROBE2(name, a, b) DTRACE_PROBE2(sha256, name, a, b)
+#define SHA256_PROBE3(name, a, b, c) DTRACE_PROBE3(sha256, name, a, b, c)
+#else
+#define SHA256_PROBE2(name, a, b) ((void)0)
+#define SHA256_PROBE3(name, a, b, c) ((void)0)
+#endif
+
+#endif /* SHA256_PROBES_H */
@@ -0,0 +1,303 @@
+/**
+ * sha256_queue.c - Lock-free submission queue feeding batch hashing workers.
+ *
+ * The ring is a bounded MPMC queue in the style of Dmitry Vyukov's: every
+ * cell carries a sequence number that tells producers and consumers whose
+ * turn it is, so a submit or take is one CAS on the shared position plus
+ * one release store on the cell.
+ *
+ * Idle workers spin for a while, then sleep on a futex keyed by work_seq,
+ * which producers bump after every submit. Job completion uses the same
+ * spin-then-park scheme on job->state.
+ */
+#define _GNU_SOURCE
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <sched.h>
+#endif
+
+#include "sha256.h"
+#include "sha256_queue.h"
+
+// Largest batch a worker hashes at once.
+#define SHA256_QUEUE_MAX_BATCH 64
+
+// Polls before a waiter parks on its futex. A pause is tens of cycles, so
+// this is a few microseconds: about one small batch.
+#define SHA256_QUEUE_SPINS 128
+
+// Job states.
+#define JOB_PENDING 0
+#define JOB_DONE 1
+#define JOB_PARKED 2    // pending, and the owner is asleep on the futex
+
+typedef struct {
+  uint64_t seq;
+  sha256_job* job;
+} sha256_cell;
+
+struct sha256_queue {
+  _Alignas(64) uint64_t enqueue_pos;
+  _Alignas(64) uint64_t dequeue_pos;
+  _Alignas(64) uint32_t work_seq;
+  uint32_t sleepers;
+  int stop;
+  _Alignas(64) sha256_cell* cells;
+  uint64_t mask;
+  uint32_t batch;
+  uint64_t deadline_ns;
+  int nworkers;
+  pthread_t* workers;
+};
+
+static void futex_wait(uint32_t* addr, uint32_t val) {
+#ifdef __linux__
+  syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+#else
+  (void)addr;
+  (void)val;
+  sched_yield();
+#endif
+}
+
+static void futex_wake(uint32_t* addr, int n) {
+#ifdef __linux__
+  syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+#else
+  (void)addr;
+  (void)n;
+#endif
+}
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int ring_push(sha256_queue* q, sha256_job* job) {
+  uint64_t pos = __atomic_load_n(&q->enqueue_pos, __ATOMIC_RELAXED);
+  sha256_cell* cell;
+
+  for (;;) {
+    cell = &q->cells[pos & q->mask];
+    uint64_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+    int64_t diff = (int64_t)(seq - pos);
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&q->enqueue_pos, &pos, pos + 1, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        break;
+      }
+    } else if (diff < 0) {
+      return -1;   // full
+    } else {
+      pos = __atomic_load_n(&q->enqueue_pos, __ATOMIC_RELAXED);
+    }
+  }
+
+  cell->job = job;
+  __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+  return 0;
+}
+
+static sha256_job* ring_pop(sha256_queue* q) {
+  uint64_t pos = __atomic_load_n(&q->dequeue_pos, __ATOMIC_RELAXED);
+  sha256_cell* cell;
+
+  for (;;) {
+    cell = &q->cells[pos & q->mask];
+    uint64_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+    int64_t diff = (int64_t)(seq - (pos + 1));
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&q->dequeue_pos, &pos, pos + 1, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        break;
+      }
+    } else if (diff < 0) {
+      return NULL;   // empty
+    } else {
+      pos = __atomic_load_n(&q->dequeue_pos, __ATOMIC_RELAXED);
+    }
+  }
+
+  sha256_job* job = cell->job;
+  __atomic_store_n(&cell->seq, pos + q->mask + 1, __ATOMIC_RELEASE);
+  return job;
+}
+
+static int ring_empty(sha256_queue* q) {
+  return __atomic_load_n(&q->dequeue_pos, __ATOMIC_SEQ_CST) ==
+         __atomic_load_n(&q->enqueue_pos, __ATOMIC_SEQ_CST);
+}
+
+// Sleep until a producer bumps work_seq. The sleeper count is raised before
+// the last emptiness check, so a producer that enqueues after that check is
+// guaranteed to see it and wake us.
+static void worker_park(sha256_queue* q) {
+  for (int i = 0; i < SHA256_QUEUE_SPINS; i++) {
+    if (!ring_empty(q) || __atomic_load_n(&q->stop, __ATOMIC_ACQUIRE)) {
+      return;
+    }
+    cpu_relax();
+  }
+
+  __atomic_add_fetch(&q->sleepers, 1, __ATOMIC_SEQ_CST);
+  uint32_t seq = __atomic_load_n(&q->work_seq, __ATOMIC_SEQ_CST);
+  if (ring_empty(q) && !__atomic_load_n(&q->stop, __ATOMIC_ACQUIRE)) {
+    futex_wait(&q->work_seq, seq);
+  }
+  __atomic_sub_fetch(&q->sleepers, 1, __ATOMIC_SEQ_CST);
+}
+
+static void job_complete(sha256_job* job) {
+  if (__atomic_exchange_n(&job->state, JOB_DONE, __ATOMIC_RELEASE) == JOB_PARKED) {
+    futex_wake(&job->state, INT_MAX);
+  }
+}
+
+static void* worker_main(void* arg) {
+  sha256_queue* q = arg;
+  sha256_job* jobs[SHA256_QUEUE_MAX_BATCH];
+  const unsigned char* msgs[SHA256_QUEUE_MAX_BATCH];
+  uint64_t lens[SHA256_QUEUE_MAX_BATCH];
+  unsigned char* outs[SHA256_QUEUE_MAX_BATCH];
+
+  for (;;) {
+    uint32_t n = 0;
+    sha256_job* job;
+
+    while (n < q->batch && (job = ring_pop(q)) != NULL) {
+      jobs[n++] = job;
+    }
+    if (n == 0) {
+      if (__atomic_load_n(&q->stop, __ATOMIC_ACQUIRE)) {
+        return NULL;
+      }
+      worker_park(q);
+      continue;
+    }
+
+    // Give the batch until the deadline to fill up.
+    if (n < q->batch && q->deadline_ns > 0) {
+      uint64_t deadline = now_ns() + q->deadline_ns;
+      while (n < q->batch && now_ns() < deadline) {
+        if ((job = ring_pop(q)) != NULL) {
+          jobs[n++] = job;
+        } else {
+          cpu_relax();
+        }
+      }
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+      msgs[i] = jobs[i]->msg;
+      lens[i] = jobs[i]->len;
+      outs[i] = jobs[i]->digest;
+    }
+    sha256_hash_batch(msgs, lens, n, outs);
+    for (uint32_t i = 0; i < n; i++) {
+      job_complete(jobs[i]);
+    }
+  }
+}
+
+sha256_queue* sha256_queue_create(uint32_t capacity, int nworkers, uint32_t batch,
+                                  uint32_t deadline_us) {
+  uint64_t size = 2;
+  while (size < capacity) {
+    size <<= 1;
+  }
+  if (batch == 0) {
+    batch = 1;
+  } else if (batch > SHA256_QUEUE_MAX_BATCH) {
+    batch = SHA256_QUEUE_MAX_BATCH;
+  }
+
+  sha256_queue* q = aligned_alloc(64, sizeof(*q));
+  if (q == NULL) {
+    return NULL;
+  }
+  memset(q, 0, sizeof(*q));
+  q->cells = malloc(size * sizeof(sha256_cell));
+  q->workers = malloc(nworkers * sizeof(pthread_t));
+  if (q->cells == NULL || q->workers == NULL) {
+    free(q->cells);
+    free(q->workers);
+    free(q);
+    return NULL;
+  }
+  for (uint64_t i = 0; i < size; i++) {
+    q->cells[i].seq = i;
+  }
+  q->mask = size - 1;
+  q->batch = batch;
+  q->deadline_ns = (uint64_t)deadline_us * 1000;
+
+  for (q->nworkers = 0; q->nworkers < nworkers; q->nworkers++) {
+    if (pthread_create(&q->workers[q->nworkers], NULL, worker_main, q) != 0) {
+      sha256_queue_destroy(q);
+      return NULL;
+    }
+  }
+  return q;
+}
+
+void sha256_queue_destroy(sha256_queue* q) {
+  __atomic_store_n(&q->stop, 1, __ATOMIC_SEQ_CST);
+  __atomic_add_fetch(&q->work_seq, 1, __ATOMIC_SEQ_CST);
+  futex_wake(&q->work_seq, INT_MAX);
+  for (int i = 0; i < q->nworkers; i++) {
+    pthread_join(q->workers[i], NULL);
+  }
+  free(q->cells);
+  free(q->workers);
+  free(q);
+}
+
+void sha256_job_init(sha256_job* job, const unsigned char* msg, uint64_t len) {
+  job->msg = msg;
+  job->len = len;
+  job->state = JOB_PENDING;
+}
+
+int sha256_queue_submit(sha256_queue* q, sha256_job* job) {
+  if (ring_push(q, job) != 0) {
+    return -1;
+  }
+  __atomic_add_fetch(&q->work_seq, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&q->sleepers, __ATOMIC_SEQ_CST) > 0) {
+    futex_wake(&q->work_seq, 1);
+  }
+  return 0;
+}
+
+void sha256_job_wait(sha256_job* job) {
+  for (int i = 0; i < SHA256_QUEUE_SPINS; i++) {
+    if (__atomic_load_n(&job->state, __ATOMIC_ACQUIRE) == JOB_DONE) {
+      return;
+    }
+    cpu_relax();
+  }
+
+  uint32_t expected = JOB_PENDING;
+  __atomic_compare_exchange_n(&job->state, &expected, JOB_PARKED, 0,
+                              __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE);
+  while (__atomic_load_n(&job->state, __ATOMIC_ACQUIRE) != JOB_DONE) {
+    futex_wait(&job->state, JOB_PARKED);
+  }
+}
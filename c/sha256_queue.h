@@ -0,0 +1,56 @@
+/**
+ * sha256_queue.h - Lock-free submission queue feeding batch hashing workers.
+ *
+ * Many threads each hashing one small message waste the SIMD lanes. Instead,
+ * producers submit jobs to a bounded lock-free MPMC ring; worker threads
+ * drain it in batches (up to `batch` jobs, waiting at most `deadline_us` for
+ * a batch to fill) and hash each batch with sha256_hash_batch(). Producers
+ * wait for their job by spinning briefly, then parking on a futex.
+ *
+ *   sha256_job job;
+ *   sha256_job_init(&job, msg, len);
+ *   while (sha256_queue_submit(q, &job) != 0)
+ *     ;                                  // ring full
+ *   sha256_job_wait(&job);               // job.digest is ready
+ */
+#ifndef SHA256_QUEUE_H
+#define SHA256_QUEUE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+  const unsigned char* msg;
+  uint64_t len;
+  unsigned char digest[32];
+  uint32_t state;            // completion word, see sha256_queue.c
+} sha256_job;
+
+typedef struct sha256_queue sha256_queue;
+
+/*
+ * Create a queue with room for capacity jobs (rounded up to a power of two)
+ * and start nworkers threads. Returns NULL on failure.
+ */
+sha256_queue* sha256_queue_create(uint32_t capacity, int nworkers, uint32_t batch,
+                                  uint32_t deadline_us);
+
+// Stop the workers once the queue is drained and free it.
+void sha256_queue_destroy(sha256_queue* q);
+
+void sha256_job_init(sha256_job* job, const unsigned char* msg, uint64_t len);
+
+// Returns 0 when queued, -1 when the ring is full.
+int sha256_queue_submit(sha256_queue* q, sha256_job* job);
+
+// Block until job->digest is written.
+void sha256_job_wait(sha256_job* job);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SHA256_QUEUE_H */
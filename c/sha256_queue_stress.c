@@ -0,0 +1,218 @@
+/**
+ * sha256_queue_stress.c - Stress test for the submission queue.
+ *
+ * P producer threads push jobs through one queue drained by W workers and
+ * check every digest against sha256_hash(). Each producer keeps a window
+ * of jobs in flight and waits on them out of order, so the ring fills up,
+ * batches mix jobs from several producers, and waiters both spin and park.
+ * Message lengths span the one- and two-block padding cases and a few
+ * multi-block messages.
+ *
+ *   gcc -O2 -pthread -DSHA256_NO_MAIN -o sha256_queue_stress sha256_queue_stress.c sha256_queue.c sha256.c
+ *   gcc -O1 -g -fsanitize=thread -pthread -DSHA256_NO_MAIN -o sha256_queue_stress \
+ *       sha256_queue_stress.c sha256_queue.c sha256.c
+ *   ./sha256_queue_stress [-p producers] [-w workers] [-j jobs] [-b batch]
+ *                         [-d deadline_us] [-c capacity] [-s seed]
+ *
+ * Every producer submits -j jobs. A wrong digest aborts with the producer,
+ * job and length; a lost job shows up as a hang, which SIGALRM turns into a
+ * failure after STRESS_TIMEOUT seconds.
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sha256.h"
+#include "sha256_queue.h"
+
+// Jobs each producer has in flight at once.
+#define STRESS_WINDOW 32
+
+// Longest message, in bytes.
+#define STRESS_MAX_LEN 1024
+
+#define STRESS_TIMEOUT 300
+
+typedef struct {
+  uint64_t s;
+} stress_rng;
+
+static uint64_t stress_next(stress_rng* r) {
+  r->s ^= r->s << 13;
+  r->s ^= r->s >> 7;
+  r->s ^= r->s << 17;
+  return r->s;
+}
+
+typedef struct {
+  sha256_queue* q;
+  int id;
+  uint64_t njobs;
+  uint64_t seed;
+  uint64_t full;       // submits refused because the ring was full
+} producer;
+
+static uint64_t stress_len(stress_rng* r) {
+  uint64_t x = stress_next(r);
+  switch (x & 7) {
+    case 0: return 0;
+    case 1: return 55 + (x >> 8) % 3;                  // the padding boundary
+    case 2: return 64 * (1 + (x >> 8) % 4) + (x >> 16) % 2;
+    case 3: return (x >> 8) % (STRESS_MAX_LEN + 1);
+    default: return (x >> 8) % 120;
+  }
+}
+
+static void fill(stress_rng* r, unsigned char* buf, uint64_t len) {
+  for (uint64_t i = 0; i < len; i++) {
+    buf[i] = (unsigned char)stress_next(r);
+  }
+}
+
+static void check(producer* p, uint64_t n, sha256_job* job) {
+  unsigned char want[32];
+
+  sha256_hash(job->msg, job->len, want);
+  if (memcmp(job->digest, want, 32) != 0) {
+    fprintf(stderr, "producer %d job %llu (%llu bytes): wrong digest\n", p->id,
+            (unsigned long long)n, (unsigned long long)job->len);
+    abort();
+  }
+}
+
+static void submit(producer* p, sha256_job* job) {
+  while (sha256_queue_submit(p->q, job) != 0) {
+    p->full++;
+    sched_yield();
+  }
+}
+
+static void* producer_main(void* arg) {
+  producer* p = arg;
+  stress_rng rng = { p->seed | 1 };
+  sha256_job jobs[STRESS_WINDOW];
+  uint64_t ids[STRESS_WINDOW];
+  unsigned char* bufs[STRESS_WINDOW];
+  int busy[STRESS_WINDOW] = { 0 };
+  uint64_t next = 0, done = 0;
+  int inflight = 0;
+
+  for (int i = 0; i < STRESS_WINDOW; i++) {
+    bufs[i] = malloc(STRESS_MAX_LEN);
+  }
+
+  while (done < p->njobs) {
+    // Top the window up by a random amount, then retire a random job, so
+    // the window size keeps changing and jobs complete out of order. A
+    // queued job must not move, so slots are reused in place.
+    int add = (int)(stress_next(&rng) % (STRESS_WINDOW + 1));
+    for (int i = 0; i < STRESS_WINDOW && add > 0 && next < p->njobs; i++) {
+      if (busy[i]) {
+        continue;
+      }
+      uint64_t len = stress_len(&rng);
+      fill(&rng, bufs[i], len);
+      sha256_job_init(&jobs[i], bufs[i], len);
+      ids[i] = next++;
+      busy[i] = 1;
+      inflight++;
+      add--;
+      submit(p, &jobs[i]);
+    }
+    if (inflight == 0) {
+      continue;
+    }
+
+    int k = (int)(stress_next(&rng) % STRESS_WINDOW);
+    while (!busy[k]) {
+      k = (k + 1) % STRESS_WINDOW;
+    }
+    sha256_job_wait(&jobs[k]);
+    check(p, ids[k], &jobs[k]);
+    busy[k] = 0;
+    inflight--;
+    done++;
+  }
+
+  for (int i = 0; i < STRESS_WINDOW; i++) {
+    free(bufs[i]);
+  }
+  return NULL;
+}
+
+static void on_alarm(int sig) {
+  (void)sig;
+  static const char msg[] = "sha256_queue_stress: timed out, a job was lost\n";
+  write(2, msg, sizeof(msg) - 1);
+  _exit(1);
+}
+
+int main(int argc, char** argv) {
+  int nproducers = 8, nworkers = 4;
+  uint64_t njobs = 20000, seed = (uint64_t)time(NULL);
+  uint32_t batch = 16, deadline_us = 20, capacity = 64;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "p:w:j:b:d:c:s:")) != -1) {
+    switch (opt) {
+      case 'p': nproducers = atoi(optarg); break;
+      case 'w': nworkers = atoi(optarg); break;
+      case 'j': njobs = strtoull(optarg, NULL, 10); break;
+      case 'b': batch = (uint32_t)strtoul(optarg, NULL, 10); break;
+      case 'd': deadline_us = (uint32_t)strtoul(optarg, NULL, 10); break;
+      case 'c': capacity = (uint32_t)strtoul(optarg, NULL, 10); break;
+      case 's': seed = strtoull(optarg, NULL, 0); break;
+      default:
+        fprintf(stderr, "usage: %s [-p producers] [-w workers] [-j jobs] [-b batch] "
+                "[-d deadline_us] [-c capacity] [-s seed]\n", argv[0]);
+        return 2;
+    }
+  }
+  if (nproducers < 1 || nworkers < 1) {
+    fprintf(stderr, "need at least one producer and one worker\n");
+    return 2;
+  }
+
+  signal(SIGALRM, on_alarm);
+  alarm(STRESS_TIMEOUT);
+
+  sha256_queue* q = sha256_queue_create(capacity, nworkers, batch, deadline_us);
+  if (q == NULL) {
+    fprintf(stderr, "sha256_queue_create failed\n");
+    return 1;
+  }
+
+  producer* ps = calloc(nproducers, sizeof(producer));
+  pthread_t* threads = calloc(nproducers, sizeof(pthread_t));
+  stress_rng rng = { seed | 1 };
+  for (int i = 0; i < nproducers; i++) {
+    ps[i].q = q;
+    ps[i].id = i;
+    ps[i].njobs = njobs;
+    ps[i].seed = stress_next(&rng);
+    if (pthread_create(&threads[i], NULL, producer_main, &ps[i]) != 0) {
+      fprintf(stderr, "pthread_create failed\n");
+      return 1;
+    }
+  }
+
+  uint64_t full = 0;
+  for (int i = 0; i < nproducers; i++) {
+    pthread_join(threads[i], NULL);
+    full += ps[i].full;
+  }
+  sha256_queue_destroy(q);
+
+  printf("seed %llu: %d producers x %d workers, %llu jobs ok, ring full %llu times\n",
+         (unsigned long long)seed, nproducers, nworkers,
+         (unsigned long long)njobs * nproducers, (unsigned long long)full);
+  free(ps);
+  free(threads);
+  return 0;
+}
@@ -0,0 +1,170 @@
+/**
+ * sha256_shm.c - Client side of the shared-memory hashing service.
+ *
+ * The arena is used as a byte ring. Requests finish in submission order, so
+ * each response frees the arena up to the end of its message. A message is
+ * never split across the end of the arena; the bytes skipped to avoid that
+ * are freed along with it.
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sha256_shm.h"
+
+struct sha256_shm_client {
+  sha256_shm_segment* seg;
+  sha256_shm_slot* slot;
+  uint64_t arena_head;     // next free byte, counting from the start
+  uint64_t arena_tail;     // first byte still in use
+  uint64_t reserved;       // start of the outstanding reservation
+  uint64_t ends[SHA256_SHM_RING];   // arena_head after each in-flight request
+  uint32_t sent;
+  uint32_t received;
+};
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+uint64_t sha256_shm_start_time(int32_t pid) {
+  char path[64], buf[1024];
+  snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return 0;
+  }
+  ssize_t n = read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  if (n <= 0) {
+    return 0;
+  }
+  buf[n] = 0;
+
+  // The command name is in parentheses and may contain anything, so fields
+  // are counted from the last ')', which ends field 2. starttime is field 22.
+  char* p = strrchr(buf, ')');
+  for (int field = 3; p != NULL && field <= 22; field++) {
+    p = strchr(p + 1, ' ');   // the space before field
+  }
+  return p != NULL ? strtoull(p + 1, NULL, 10) : 0;
+}
+
+sha256_shm_client* sha256_shm_attach(const char* name) {
+  int fd = shm_open(name, O_RDWR, 0);
+  if (fd < 0) {
+    return NULL;
+  }
+  void* p = mmap(NULL, sizeof(sha256_shm_segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    return NULL;
+  }
+
+  sha256_shm_segment* seg = p;
+  sha256_shm_client* c = NULL;
+  if (__atomic_load_n(&seg->magic, __ATOMIC_ACQUIRE) == SHA256_SHM_MAGIC) {
+    c = calloc(1, sizeof(*c));
+  }
+  if (c == NULL) {
+    munmap(p, sizeof(sha256_shm_segment));
+    return NULL;
+  }
+
+  for (uint32_t i = 0; i < seg->nslots; i++) {
+    uint32_t expected = SHA256_SLOT_FREE;
+    if (__atomic_compare_exchange_n(&seg->slots[i].state, &expected, SHA256_SLOT_CLAIMED, 0,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+      c->slot = &seg->slots[i];
+      break;
+    }
+  }
+  if (c->slot == NULL) {
+    free(c);
+    munmap(p, sizeof(sha256_shm_segment));
+    return NULL;
+  }
+
+  // The ring counters carry over from the previous owner, who left both
+  // rings drained; only the statistics start over.
+  sha256_shm_slot* s = c->slot;
+  c->seg = seg;
+  c->sent = s->req_ring.head;
+  c->received = s->resp_ring.tail;
+  memset(&s->stats, 0, sizeof(s->stats));
+  s->pid = getpid();
+  s->pid_start = sha256_shm_start_time(s->pid);
+  __atomic_store_n(&s->state, SHA256_SLOT_ACTIVE, __ATOMIC_RELEASE);
+  return c;
+}
+
+void sha256_shm_detach(sha256_shm_client* c) {
+  uint64_t id;
+  unsigned char digest[32];
+
+  while (c->received != c->sent) {
+    sha256_shm_poll(c, &id, digest);
+  }
+  __atomic_store_n(&c->slot->state, SHA256_SLOT_FREE, __ATOMIC_RELEASE);
+  munmap(c->seg, sizeof(sha256_shm_segment));
+  free(c);
+}
+
+unsigned char* sha256_shm_alloc(sha256_shm_client* c, uint64_t len) {
+  uint64_t pos = c->arena_head % SHA256_SHM_ARENA;
+  uint64_t skip = pos + len > SHA256_SHM_ARENA ? SHA256_SHM_ARENA - pos : 0;
+
+  if (len > SHA256_SHM_ARENA ||
+      c->arena_head - c->arena_tail + skip + len > SHA256_SHM_ARENA) {
+    return NULL;
+  }
+  c->reserved = c->arena_head + skip;
+  return c->slot->arena + c->reserved % SHA256_SHM_ARENA;
+}
+
+int sha256_shm_submit(sha256_shm_client* c, const unsigned char* p, uint64_t len,
+                      uint64_t id) {
+  sha256_shm_slot* s = c->slot;
+
+  // At most a ring's worth in flight, so the daemon never finds the
+  // response ring full.
+  if (c->sent - c->received == SHA256_SHM_RING) {
+    return -1;
+  }
+
+  sha256_shm_req* r = &s->req[c->sent % SHA256_SHM_RING];
+  r->id = id;
+  r->off = (uint64_t)(p - s->arena);
+  r->len = len;
+  r->t_submit = now_ns();
+
+  c->arena_head = c->reserved + len;
+  c->ends[c->sent % SHA256_SHM_RING] = c->arena_head;
+  c->sent++;
+  __atomic_store_n(&s->req_ring.head, c->sent, __ATOMIC_RELEASE);
+  return 0;
+}
+
+int sha256_shm_poll(sha256_shm_client* c, uint64_t* id, unsigned char* digest) {
+  sha256_shm_slot* s = c->slot;
+
+  if (__atomic_load_n(&s->resp_ring.head, __ATOMIC_ACQUIRE) == c->received) {
+    return 0;
+  }
+  sha256_shm_resp* r = &s->resp[c->received % SHA256_SHM_RING];
+  *id = r->id;
+  memcpy(digest, r->digest, 32);
+
+  c->arena_tail = c->ends[c->received % SHA256_SHM_RING];
+  c->received++;
+  __atomic_store_n(&s->resp_ring.tail, c->received, __ATOMIC_RELEASE);
+  return 1;
+}
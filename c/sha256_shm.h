@@ -0,0 +1,120 @@
+/**
+ * sha256_shm.h - Hashing service for processes on the same host.
+ *
+ * sha256_shmd owns a POSIX shared-memory segment split into client slots.
+ * Each slot holds a data arena and two single-producer single-consumer rings:
+ * requests from the client to the daemon, responses back. A client writes its
+ * message straight into the arena and submits (offset, length), so neither
+ * side copies the data and the fast path makes no system calls. The daemon
+ * sweeps every slot, gathers requests from all clients into one batch for
+ * sha256_hash_batch() and keeps latency statistics per slot.
+ *
+ *   sha256_shm_client* c = sha256_shm_attach(SHA256_SHM_NAME);
+ *   unsigned char* p = sha256_shm_alloc(c, len);
+ *   memcpy(p, msg, len);                 // or produce the data in place
+ *   sha256_shm_submit(c, p, len, id);
+ *   while (!sha256_shm_poll(c, &id, digest))
+ *     ;                                  // responses come back in order
+ */
+#ifndef SHA256_SHM_H
+#define SHA256_SHM_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SHA256_SHM_NAME "/sha256d"
+#define SHA256_SHM_MAGIC 0x53484132u     // "SHA2"
+#define SHA256_SHM_CLIENTS 16
+#define SHA256_SHM_RING 256              // entries per ring, a power of two
+#define SHA256_SHM_ARENA (1u << 20)      // data bytes per client
+
+/* Segment layout, shared by the daemon and its clients. */
+
+typedef struct {
+  uint64_t id;
+  uint64_t off;        // into the slot's arena
+  uint64_t len;
+  uint64_t t_submit;   // CLOCK_MONOTONIC ns
+} sha256_shm_req;
+
+typedef struct {
+  uint64_t id;
+  unsigned char digest[32];
+} sha256_shm_resp;
+
+// head is written only by the producer, tail only by the consumer. Both only
+// ever grow; an entry's index is its count modulo SHA256_SHM_RING.
+typedef struct {
+  _Alignas(64) uint32_t head;
+  _Alignas(64) uint32_t tail;
+} sha256_shm_ring;
+
+typedef struct {
+  uint64_t requests;
+  uint64_t lat_sum_ns;   // submit to digest written
+  uint64_t lat_max_ns;
+  uint64_t batched;      // sum of the sizes of the batches this slot's requests ran in
+} sha256_shm_stats;
+
+#define SHA256_SLOT_FREE 0
+#define SHA256_SLOT_CLAIMED 1   // a client is initializing it
+#define SHA256_SLOT_ACTIVE 2
+
+// A process is identified by its pid and its start time, since pids are
+// reused; see sha256_shm_start_time().
+typedef struct {
+  _Alignas(64) uint32_t state;
+  int32_t pid;
+  uint64_t pid_start;
+  sha256_shm_stats stats;
+  sha256_shm_ring req_ring;
+  sha256_shm_req req[SHA256_SHM_RING];
+  sha256_shm_ring resp_ring;
+  sha256_shm_resp resp[SHA256_SHM_RING];
+  _Alignas(64) unsigned char arena[SHA256_SHM_ARENA];
+} sha256_shm_slot;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t nslots;
+  int32_t owner_pid;       // the daemon serving the segment
+  uint64_t owner_start;
+  sha256_shm_slot slots[SHA256_SHM_CLIENTS];
+} sha256_shm_segment;
+
+// Start time of process pid in clock ticks since boot (/proc/<pid>/stat), or
+// 0 if there is no such process or /proc is unavailable.
+uint64_t sha256_shm_start_time(int32_t pid);
+
+/* Client interface. */
+
+typedef struct sha256_shm_client sha256_shm_client;
+
+// Map the daemon's segment and claim a slot. Returns NULL on failure.
+sha256_shm_client* sha256_shm_attach(const char* name);
+
+// Wait for outstanding requests, release the slot and unmap.
+void sha256_shm_detach(sha256_shm_client* c);
+
+/*
+ * Reserve len bytes of the arena for the next message. Returns NULL while
+ * the arena is too full; poll for responses to free space. The reservation
+ * must be submitted before the next one is made.
+ */
+unsigned char* sha256_shm_alloc(sha256_shm_client* c, uint64_t len);
+
+// Submit the reserved message at p. Returns 0, or -1 if the ring is full.
+int sha256_shm_submit(sha256_shm_client* c, const unsigned char* p, uint64_t len,
+                      uint64_t id);
+
+// Fetch the oldest finished request. Returns 1 if one was ready, else 0.
+int sha256_shm_poll(sha256_shm_client* c, uint64_t* id, unsigned char* digest);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SHA256_SHM_H */
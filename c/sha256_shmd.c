@@ -0,0 +1,310 @@
+/**
+ * sha256_shmd.c - Shared-memory hashing daemon.
+ *
+ * Creates the segment described in sha256_shm.h and serves every client slot
+ * from one thread: each sweep takes requests from all slots round-robin until
+ * the batch is full, or until the coalescing deadline passes, hashes them with
+ * one sha256_hash_batch() call and publishes the digests. Nothing wakes the
+ * daemon, so after a stretch of idle sweeps it polls with short sleeps;
+ * while requests keep coming it never leaves user space.
+ *
+ *   gcc -O2 -DSHA256_NO_MAIN -o sha256_shmd sha256_shmd.c sha256_shm.c sha256.c
+ *   gcc -O2 app.c sha256_shm.c              # clients
+ *
+ *   ./sha256_shmd [-n name] [-b batch] [-d deadline_us] [-i report_s]
+ *
+ * Per-client latency (submit to digest written) is printed every report_s
+ * seconds and on SIGINT/SIGTERM.
+ *
+ * The segment and every slot record their owner's pid and start time. A
+ * second daemon refuses a name whose owner is still running, and slots of
+ * clients that exited without detaching are freed within REAP_NS; a reused
+ * pid does not keep either alive, since its start time differs.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sha256.h"
+#include "sha256_shm.h"
+
+#define MAX_BATCH 64
+
+// Empty sweeps before the daemon starts sleeping between sweeps.
+#define IDLE_SPINS 4096
+#define IDLE_SLEEP_NS 50000
+// How often slots of exited clients are looked for.
+#define REAP_NS 100000000ULL
+
+typedef struct {
+  sha256_shm_slot* slot;
+  uint64_t t_submit;
+} pending;
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig) {
+  (void)sig;
+  stop = 1;
+}
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Is the process that recorded (pid, start) still running? Without /proc,
+// only the pid can be checked.
+static int process_alive(int32_t pid, uint64_t start) {
+  uint64_t now = sha256_shm_start_time(pid);
+  if (now != 0) {
+    return start == 0 || now == start;
+  }
+  return !(kill(pid, 0) != 0 && errno == ESRCH);
+}
+
+// An existing segment is stale once its daemon is gone. One whose magic never
+// appears was left by a daemon that died while creating it.
+static int segment_stale(const char* name) {
+  int fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0) {
+    return errno == ENOENT;
+  }
+  int stale = 1;
+  for (int tries = 0; tries < 20; tries++) {
+    struct stat st;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(sha256_shm_segment)) {
+      sha256_shm_segment* seg = mmap(NULL, sizeof(*seg), PROT_READ, MAP_SHARED, fd, 0);
+      if (seg != MAP_FAILED) {
+        int ready = __atomic_load_n(&seg->magic, __ATOMIC_ACQUIRE) == SHA256_SHM_MAGIC;
+        if (ready) {
+          stale = !process_alive(seg->owner_pid, seg->owner_start);
+        }
+        munmap(seg, sizeof(*seg));
+        if (ready) {
+          break;
+        }
+      }
+    }
+    struct timespec ts = { 0, 10000000 };
+    nanosleep(&ts, NULL);
+  }
+  close(fd);
+  return stale;
+}
+
+// Fails with EEXIST while another daemon serves name.
+static sha256_shm_segment* create_segment(const char* name) {
+  int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0660);
+  if (fd < 0 && errno == EEXIST && segment_stale(name)) {
+    shm_unlink(name);
+    fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0660);
+  }
+  if (fd < 0) {
+    return NULL;
+  }
+  if (ftruncate(fd, sizeof(sha256_shm_segment)) != 0) {
+    close(fd);
+    shm_unlink(name);
+    return NULL;
+  }
+  void* p = mmap(NULL, sizeof(sha256_shm_segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    shm_unlink(name);
+    return NULL;
+  }
+
+  // The new object is zero-filled: every slot free, every ring empty.
+  sha256_shm_segment* seg = p;
+  seg->nslots = SHA256_SHM_CLIENTS;
+  seg->owner_pid = getpid();
+  seg->owner_start = sha256_shm_start_time(seg->owner_pid);
+  __atomic_store_n(&seg->magic, SHA256_SHM_MAGIC, __ATOMIC_RELEASE);
+  return seg;
+}
+
+// Take up to max - n requests from slot s, appending to the batch.
+static uint32_t take(sha256_shm_slot* s, uint32_t n, uint32_t max,
+                     const unsigned char** msgs, uint64_t* lens, unsigned char** outs,
+                     pending* pend) {
+  if (__atomic_load_n(&s->state, __ATOMIC_ACQUIRE) != SHA256_SLOT_ACTIVE) {
+    return n;
+  }
+  uint32_t head = __atomic_load_n(&s->req_ring.head, __ATOMIC_ACQUIRE);
+  uint32_t tail = s->req_ring.tail;
+
+  // Responses go out in request order, so the response for the request at
+  // index tail lands at the same index of the response ring.
+  for (; tail != head && n < max; tail++, n++) {
+    sha256_shm_req* r = &s->req[tail % SHA256_SHM_RING];
+    sha256_shm_resp* out = &s->resp[tail % SHA256_SHM_RING];
+    uint64_t off = r->off % SHA256_SHM_ARENA;
+    uint64_t len = r->len <= SHA256_SHM_ARENA - off ? r->len : 0;   // bounds
+
+    out->id = r->id;
+    msgs[n] = s->arena + off;
+    lens[n] = len;
+    outs[n] = out->digest;
+    pend[n].slot = s;
+    pend[n].t_submit = r->t_submit;
+  }
+  __atomic_store_n(&s->req_ring.tail, tail, __ATOMIC_RELAXED);
+  return n;
+}
+
+static void report(sha256_shm_segment* seg) {
+  printf("%4s %8s %12s %12s %12s %10s\n", "slot", "pid", "requests", "mean us", "max us",
+         "avg batch");
+  for (uint32_t i = 0; i < seg->nslots; i++) {
+    sha256_shm_slot* s = &seg->slots[i];
+    if (s->state != SHA256_SLOT_ACTIVE || s->stats.requests == 0) {
+      continue;
+    }
+    sha256_shm_stats* st = &s->stats;
+    printf("%4u %8d %12llu %12.2f %12.2f %10.2f\n", i, s->pid,
+           (unsigned long long)st->requests, st->lat_sum_ns / 1e3 / st->requests,
+           st->lat_max_ns / 1e3, (double)st->batched / st->requests);
+  }
+  fflush(stdout);
+}
+
+// Free the slots of clients that exited without detaching. Every request
+// they submitted has been answered (this thread answers them), so dropping
+// the unread responses leaves both rings drained for the next owner.
+static void reap(sha256_shm_segment* seg) {
+  for (uint32_t i = 0; i < seg->nslots; i++) {
+    sha256_shm_slot* s = &seg->slots[i];
+    if (__atomic_load_n(&s->state, __ATOMIC_ACQUIRE) == SHA256_SLOT_ACTIVE &&
+        !process_alive(s->pid, s->pid_start)) {
+      uint32_t head = s->req_ring.head;
+      s->req_ring.tail = head;
+      s->resp_ring.head = head;
+      s->resp_ring.tail = head;
+      __atomic_store_n(&s->state, SHA256_SLOT_FREE, __ATOMIC_RELEASE);
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  const char* name = SHA256_SHM_NAME;
+  uint32_t batch = 16;
+  uint64_t deadline_ns = 20000;
+  uint64_t report_ns = 10000000000ULL;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:b:d:i:")) != -1) {
+    switch (opt) {
+      case 'n': name = optarg; break;
+      case 'b': batch = (uint32_t)atoi(optarg); break;
+      case 'd': deadline_ns = strtoull(optarg, NULL, 10) * 1000; break;
+      case 'i': report_ns = strtoull(optarg, NULL, 10) * 1000000000ULL; break;
+      default:
+        fprintf(stderr, "usage: %s [-n name] [-b batch] [-d deadline_us] [-i report_s]\n",
+                argv[0]);
+        return 2;
+    }
+  }
+  if (batch == 0 || batch > MAX_BATCH) {
+    batch = MAX_BATCH;
+  }
+
+  sha256_shm_segment* seg = create_segment(name);
+  if (seg == NULL) {
+    if (errno == EEXIST) {
+      fprintf(stderr, "sha256_shmd: another daemon is serving %s\n", name);
+    } else {
+      perror("sha256_shmd: shared memory");
+    }
+    return 1;
+  }
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+
+  const unsigned char* msgs[MAX_BATCH];
+  uint64_t lens[MAX_BATCH];
+  unsigned char* outs[MAX_BATCH];
+  pending pend[MAX_BATCH];
+  uint32_t first = 0;
+  uint32_t idle = 0;
+  uint64_t next_report = now_ns() + report_ns;
+  uint64_t next_reap = now_ns() + REAP_NS;
+
+  while (!stop) {
+    uint32_t n = 0;
+    uint64_t deadline = 0;
+
+    // Sweep all slots, starting one further each time so no client is
+    // always served last, until the batch is full or the deadline passes.
+    for (;;) {
+      for (uint32_t i = 0; i < seg->nslots && n < batch; i++) {
+        n = take(&seg->slots[(first + i) % seg->nslots], n, batch, msgs, lens, outs, pend);
+      }
+      first++;
+      if (n == 0 || n == batch || deadline_ns == 0) {
+        break;
+      }
+      uint64_t t = now_ns();
+      if (deadline == 0) {
+        deadline = t + deadline_ns;
+      } else if (t >= deadline) {
+        break;
+      }
+    }
+
+    if (n == 0) {
+      if (++idle >= IDLE_SPINS) {
+        struct timespec ts = { 0, IDLE_SLEEP_NS };
+        nanosleep(&ts, NULL);
+        uint64_t t = now_ns();
+        if (t >= next_reap) {
+          reap(seg);
+          next_reap = t + REAP_NS;
+        }
+        if (t >= next_report) {
+          report(seg);
+          next_report = t + report_ns;
+        }
+      }
+      continue;
+    }
+    idle = 0;
+
+    sha256_hash_batch(msgs, lens, n, outs);
+
+    uint64_t t = now_ns();
+    for (uint32_t i = 0; i < n; i++) {
+      sha256_shm_slot* s = pend[i].slot;
+      uint64_t lat = t - pend[i].t_submit;
+      s->stats.requests++;
+      s->stats.lat_sum_ns += lat;
+      if (lat > s->stats.lat_max_ns) {
+        s->stats.lat_max_ns = lat;
+      }
+      s->stats.batched += n;
+      __atomic_store_n(&s->resp_ring.head, s->resp_ring.head + 1, __ATOMIC_RELEASE);
+    }
+
+    if (t >= next_reap) {
+      reap(seg);
+      next_reap = t + REAP_NS;
+    }
+    if (t >= next_report) {
+      report(seg);
+      next_report = t + report_ns;
+    }
+  }
+
+  report(seg);
+  shm_unlink(name);
+  return 0;
+}
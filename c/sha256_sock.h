@@ -0,0 +1,47 @@
+/**
+ * sha256_sock.h - Wire format of the Unix-socket hashing daemon (sha256_sockd).
+ *
+ * A client connects a SOCK_STREAM socket to the daemon and writes requests;
+ * each one is answered by exactly one response carrying the same id.
+ * Responses can come back in any order. All fields are in host byte order.
+ *
+ *   SHA256_SOCK_INLINE: the header is followed by len bytes of message.
+ *   SHA256_SOCK_FD:     the header is sent with sendmsg() together with one
+ *                       file descriptor (SCM_RIGHTS); the daemon reads the
+ *                       file and hashes all of it. len must be 0.
+ *
+ * A client that stops reading responses is eventually not read from, so it
+ * blocks in send(); the daemon never drops requests.
+ */
+#ifndef SHA256_SOCK_H
+#define SHA256_SOCK_H
+
+#include <stdint.h>
+
+#define SHA256_SOCK_PATH "/tmp/sha256d.sock"
+
+#define SHA256_SOCK_INLINE 1
+#define SHA256_SOCK_FD 2
+
+// Response status.
+#define SHA256_SOCK_OK 0
+#define SHA256_SOCK_ETOOBIG 1   // inline message above the daemon's limit
+#define SHA256_SOCK_EFILE 2     // no descriptor, or it could not be read whole
+#define SHA256_SOCK_EPROTO 3    // unknown request type
+#define SHA256_SOCK_ENOMEM 4    // the daemon could not allocate the request
+
+typedef struct {
+  uint32_t type;
+  uint32_t reserved;
+  uint64_t id;
+  uint64_t len;
+} sha256_sock_req;
+
+typedef struct {
+  uint64_t id;
+  int32_t status;
+  uint32_t reserved;
+  unsigned char digest[32];
+} sha256_sock_resp;
+
+#endif /* SHA256_SOCK_H */
@@ -0,0 +1,659 @@
+/**
+ * sha256_sockd.c - Unix-socket hashing daemon for clients that cannot link C.
+ *
+ * One epoll loop does all the work. Each round it reads whatever requests
+ * the ready connections have sent, up to a bounded queue, then hashes the
+ * whole queue in sha256_hash_batch() calls of up to `batch` messages and
+ * writes the responses. Requests that arrive while a round is hashing are
+ * coalesced into the next round's batches, so batches grow with load and
+ * an idle daemon answers a lone request immediately.
+ *
+ * Backpressure: a full queue ends the reading phase of a round, and a
+ * connection with more than OUT_LIMIT bytes of unsent responses is not read
+ * from until the client catches up. Unread requests stay in the socket
+ * buffer, and once that is full the client blocks in send().
+ *
+ * Files passed with SCM_RIGHTS are read with pread(), never mapped, so a
+ * client truncating its file cannot fault the daemon. A file of up to
+ * FILE_SLICE bytes is read whole and joins the batches like an inline
+ * message. A larger one is streamed FILE_SLICE bytes per round, between
+ * the rounds' reads and batches, so a multi-gigabyte file delays other
+ * clients by one slice per round rather than by the whole file.
+ *
+ *   gcc -O2 -DSHA256_NO_MAIN -o sha256_sockd sha256_sockd.c sha256.c
+ *   ./sha256_sockd [-s path] [-b batch] [-q queue] [-m max_inline]
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "sha256.h"
+#include "sha256_sock.h"
+
+#define MAX_BATCH 64
+#define IN_BUF 65536
+#define OUT_LIMIT (64 * 1024)
+#define MAX_FDS 16
+// Bytes of a large file hashed per round.
+#define FILE_SLICE (1 << 20)
+// recvmsg() calls per ready connection per round, so one busy client cannot
+// fill the queue alone.
+#define READS_PER_ROUND 4
+
+typedef struct conn conn;
+
+// A file above FILE_SLICE bytes, hashed one slice per round.
+typedef struct {
+  conn* c;
+  uint64_t id;
+  int fd;
+  uint64_t off, len;
+  sha256_ctx ctx;
+} file_job;
+
+typedef struct {
+  conn* c;
+  uint64_t id;
+  int32_t status;
+  unsigned char* data;   // inline payload, or a small file read whole
+  uint64_t len;
+  unsigned char digest[32];
+} request;
+
+struct conn {
+  int fd;
+  uint32_t events;       // current epoll interest
+  int eof;               // peer will send no more requests
+  int dead;              // socket error; drop everything
+  int touched;           // has responses to flush this round
+  int stalled;           // has buffered input the full queue left unparsed
+  uint32_t queued;       // requests in the queue or d.files
+
+  unsigned char in[IN_BUF];
+  size_t in_len;
+  request* cur;          // inline request whose payload is still arriving
+  uint64_t cur_got;
+  int fds[MAX_FDS];      // received descriptors not yet claimed
+  int nfds;
+
+  unsigned char* out;
+  size_t out_off, out_len, out_cap;
+};
+
+static struct {
+  int ep;
+  uint32_t batch;
+  uint32_t cap;
+  uint64_t max_inline;
+
+  request** queue;
+  uint32_t nqueue;
+  conn** touched;
+  uint32_t ntouched;
+  uint32_t touched_cap;
+  conn** stalled;
+  uint32_t nstalled;
+  uint32_t stalled_cap;
+  uint32_t nconns;       // both lists have room for every connection
+
+  file_job* files;
+  uint32_t nfiles;
+  uint32_t files_cap;
+  unsigned char* slice;  // FILE_SLICE bytes
+
+  uint64_t requests;
+  uint64_t batches;
+} d;
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig) {
+  (void)sig;
+  stop = 1;
+}
+
+static void conn_set_events(conn* c) {
+  uint32_t want = 0;
+  if (!c->dead) {
+    if (c->out_len > c->out_off) {
+      want |= EPOLLOUT;
+    }
+    if (!c->eof && c->out_len - c->out_off < OUT_LIMIT) {
+      want |= EPOLLIN;
+    }
+  }
+  if (want != c->events) {
+    struct epoll_event ev = { .events = want, .data.ptr = c };
+    epoll_ctl(d.ep, EPOLL_CTL_MOD, c->fd, &ev);
+    c->events = want;
+  }
+}
+
+static void conn_free(conn* c) {
+  close(c->fd);
+  for (int i = 0; i < c->nfds; i++) {
+    close(c->fds[i]);
+  }
+  if (c->cur != NULL) {
+    free(c->cur->data);
+    free(c->cur);
+  }
+  free(c->out);
+  free(c);
+  d.nconns--;
+}
+
+// A connection is finished once the peer is gone, or done and everything it
+// sent has been answered. One still on d.stalled is freed a round later.
+static int conn_finished(conn* c) {
+  if (c->touched || c->stalled || c->queued > 0) {
+    return 0;
+  }
+  return c->dead || (c->eof && !c->stalled && c->out_len == c->out_off);
+}
+
+static void conn_flush(conn* c) {
+  while (!c->dead && c->out_len > c->out_off) {
+    ssize_t n = send(c->fd, c->out + c->out_off, c->out_len - c->out_off, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno != EAGAIN && errno != EINTR) {
+        c->dead = 1;
+      }
+      if (errno != EINTR) {
+        break;
+      }
+      continue;
+    }
+    c->out_off += n;
+  }
+  if (c->out_off == c->out_len) {
+    c->out_off = c->out_len = 0;
+  }
+}
+
+// Grow a connection list to hold need entries; each connection is on a list
+// at most once, so reserving at accept time keeps conn_list_add() from
+// failing.
+static int conn_list_reserve(conn*** list, uint32_t* cap, uint32_t need) {
+  if (need > *cap) {
+    uint32_t ncap = *cap ? 2 * *cap : 64;
+    conn** p = realloc(*list, ncap * sizeof(conn*));
+    if (p == NULL) {
+      return -1;
+    }
+    *list = p;
+    *cap = ncap;
+  }
+  return 0;
+}
+
+static void conn_list_add(conn*** list, uint32_t* n, conn* c) {
+  (*list)[(*n)++] = c;
+}
+
+static void respond(conn* c, uint64_t id, int32_t status, const unsigned char* digest) {
+  if (c->out_len + sizeof(sha256_sock_resp) > c->out_cap) {
+    if (c->out_off > 0) {
+      memmove(c->out, c->out + c->out_off, c->out_len - c->out_off);
+      c->out_len -= c->out_off;
+      c->out_off = 0;
+    }
+    if (c->out_len + sizeof(sha256_sock_resp) > c->out_cap) {
+      size_t cap = c->out_cap ? 2 * c->out_cap : 4096;
+      unsigned char* p = realloc(c->out, cap);
+      if (p == NULL) {
+        c->dead = 1;     // the client would wait forever for this answer
+      } else {
+        c->out = p;
+        c->out_cap = cap;
+      }
+    }
+  }
+
+  if (!c->dead) {
+    sha256_sock_resp r = { .id = id, .status = status };
+    if (digest != NULL) {
+      memcpy(r.digest, digest, 32);
+    }
+    memcpy(c->out + c->out_len, &r, sizeof(r));
+    c->out_len += sizeof(r);
+  }
+
+  if (!c->touched) {
+    conn_list_add(&d.touched, &d.ntouched, c);
+    c->touched = 1;
+  }
+}
+
+static void enqueue(request* r) {
+  r->c->queued++;
+  d.queue[d.nqueue++] = r;
+}
+
+// recvmsg() that also collects passed descriptors.
+static ssize_t conn_recv(conn* c, void* buf, size_t len) {
+  union {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(MAX_FDS * sizeof(int))];
+  } ctl;
+  struct iovec iov = { buf, len };
+  struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1,
+                        .msg_control = ctl.buf, .msg_controllen = sizeof(ctl.buf) };
+
+  ssize_t n = recvmsg(c->fd, &msg, MSG_CMSG_CLOEXEC);
+  for (struct cmsghdr* cm = CMSG_FIRSTHDR(&msg); n >= 0 && cm != NULL;
+       cm = CMSG_NXTHDR(&msg, cm)) {
+    if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS) {
+      int nfd = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      int* fds = (int*)CMSG_DATA(cm);
+      for (int i = 0; i < nfd; i++) {
+        if (c->nfds < MAX_FDS) {
+          c->fds[c->nfds++] = fds[i];
+        } else {
+          close(fds[i]);
+        }
+      }
+    }
+  }
+  return n;
+}
+
+// pread() exactly len bytes from off; a short file is an error.
+static int read_full(int fd, unsigned char* buf, uint64_t len, uint64_t off) {
+  while (len > 0) {
+    ssize_t n = pread(fd, buf, len, (off_t)off);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return -1;
+    }
+    buf += n;
+    len -= n;
+    off += n;
+  }
+  return 0;
+}
+
+static void file_request(conn* c, uint64_t id) {
+  if (c->nfds == 0) {
+    respond(c, id, SHA256_SOCK_EFILE, NULL);
+    return;
+  }
+  int fd = c->fds[0];
+  memmove(c->fds, c->fds + 1, --c->nfds * sizeof(int));
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    close(fd);
+    respond(c, id, SHA256_SOCK_EFILE, NULL);
+    return;
+  }
+  uint64_t len = (uint64_t)st.st_size;
+
+  if (len > FILE_SLICE) {
+    if (d.nfiles == d.files_cap) {
+      uint32_t cap = d.files_cap ? 2 * d.files_cap : 16;
+      file_job* p = realloc(d.files, cap * sizeof(file_job));
+      if (p == NULL) {
+        close(fd);
+        respond(c, id, SHA256_SOCK_ENOMEM, NULL);
+        return;
+      }
+      d.files = p;
+      d.files_cap = cap;
+    }
+    file_job* f = &d.files[d.nfiles++];
+    f->c = c;
+    f->id = id;
+    f->fd = fd;
+    f->off = 0;
+    f->len = len;
+    sha256_init(&f->ctx);
+    c->queued++;
+    return;
+  }
+
+  request* r = calloc(1, sizeof(*r));
+  int32_t status = SHA256_SOCK_OK;
+  if (r == NULL || (len > 0 && (r->data = malloc(len)) == NULL)) {
+    status = SHA256_SOCK_ENOMEM;
+  } else if (read_full(fd, r->data, len, 0) != 0) {
+    status = SHA256_SOCK_EFILE;
+  }
+  close(fd);
+
+  if (status != SHA256_SOCK_OK) {
+    respond(c, id, status, NULL);
+    if (r != NULL) {
+      free(r->data);
+      free(r);
+    }
+    return;
+  }
+  r->c = c;
+  r->id = id;
+  r->len = len;
+  enqueue(r);
+}
+
+// Consume complete headers and payload bytes from c->in.
+static void conn_parse(conn* c) {
+  size_t pos = 0;
+
+  while (d.nqueue < d.cap) {
+    if (c->cur != NULL) {
+      request* r = c->cur;
+      uint64_t want = r->len - c->cur_got;
+      uint64_t n = c->in_len - pos < want ? c->in_len - pos : want;
+      if (r->data != NULL) {
+        memcpy(r->data + c->cur_got, c->in + pos, n);
+      }
+      c->cur_got += n;
+      pos += n;
+      if (c->cur_got < r->len) {
+        break;
+      }
+      c->cur = NULL;
+      if (r->status != SHA256_SOCK_OK) {
+        respond(c, r->id, r->status, NULL);
+        free(r);
+      } else {
+        enqueue(r);
+      }
+      continue;
+    }
+
+    if (c->in_len - pos < sizeof(sha256_sock_req)) {
+      break;
+    }
+    sha256_sock_req h;
+    memcpy(&h, c->in + pos, sizeof(h));
+    pos += sizeof(h);
+
+    if (h.type == SHA256_SOCK_FD) {
+      file_request(c, h.id);
+    } else if (h.type == SHA256_SOCK_INLINE) {
+      request* r = calloc(1, sizeof(*r));
+      if (r == NULL) {
+        // Without a request to discard the payload into, the stream is lost.
+        respond(c, h.id, SHA256_SOCK_ENOMEM, NULL);
+        c->eof = 1;
+        pos = c->in_len;
+        break;
+      }
+      r->c = c;
+      r->id = h.id;
+      r->len = h.len;
+      c->cur_got = 0;
+      if (h.len > d.max_inline) {
+        r->status = SHA256_SOCK_ETOOBIG;    // read and discard the payload
+      } else if (h.len > 0 && (r->data = malloc(h.len)) == NULL) {
+        r->status = SHA256_SOCK_ENOMEM;     // likewise
+      }
+      c->cur = r;
+    } else {
+      // The stream cannot be resynchronized.
+      respond(c, h.id, SHA256_SOCK_EPROTO, NULL);
+      c->eof = 1;
+      pos = c->in_len;
+      break;
+    }
+  }
+
+  memmove(c->in, c->in + pos, c->in_len - pos);
+  c->in_len -= pos;
+}
+
+static void conn_read(conn* c) {
+  // Input left over from a round that filled the queue goes first.
+  conn_parse(c);
+
+  for (int i = 0; i < READS_PER_ROUND && !c->eof && d.nqueue < d.cap; i++) {
+    ssize_t n;
+    request* r = c->cur;
+
+    // Large inline payloads are received straight into their buffer.
+    if (r != NULL && r->data != NULL && c->in_len == 0 && r->len - c->cur_got >= IN_BUF) {
+      n = conn_recv(c, r->data + c->cur_got, r->len - c->cur_got);
+      if (n > 0) {
+        c->cur_got += n;
+      }
+    } else {
+      n = conn_recv(c, c->in + c->in_len, IN_BUF - c->in_len);
+      if (n > 0) {
+        c->in_len += n;
+      }
+    }
+
+    if (n == 0) {
+      c->eof = 1;
+    } else if (n < 0) {
+      if (errno == EAGAIN || errno == EINTR) {
+        break;
+      }
+      c->eof = c->dead = 1;
+    }
+    conn_parse(c);
+  }
+
+  if (!c->dead && !c->stalled && (c->in_len >= sizeof(sha256_sock_req) ||
+                                  (c->cur != NULL && c->in_len > 0))) {
+    conn_list_add(&d.stalled, &d.nstalled, c);
+    c->stalled = 1;
+  }
+}
+
+static void hash_queue(void) {
+  const unsigned char* msgs[MAX_BATCH];
+  uint64_t lens[MAX_BATCH];
+  unsigned char* outs[MAX_BATCH];
+
+  for (uint32_t i = 0; i < d.nqueue; i += d.batch) {
+    uint32_t n = d.nqueue - i < d.batch ? d.nqueue - i : d.batch;
+    for (uint32_t j = 0; j < n; j++) {
+      request* r = d.queue[i + j];
+      msgs[j] = r->data;
+      lens[j] = r->len;
+      outs[j] = r->digest;
+    }
+    sha256_hash_batch(msgs, lens, n, outs);
+    d.batches++;
+  }
+
+  for (uint32_t i = 0; i < d.nqueue; i++) {
+    request* r = d.queue[i];
+    r->c->queued--;
+    respond(r->c, r->id, SHA256_SOCK_OK, r->digest);
+    free(r->data);
+    free(r);
+  }
+  d.requests += d.nqueue;
+  d.nqueue = 0;
+}
+
+// Hash the next slice of every large file; finished files are answered.
+// A file that shrank below its size at submission gets SHA256_SOCK_EFILE.
+static void hash_files(void) {
+  uint32_t kept = 0;
+  for (uint32_t i = 0; i < d.nfiles; i++) {
+    file_job* f = &d.files[i];
+    int32_t status = SHA256_SOCK_OK;
+    if (!f->c->dead) {
+      uint64_t n = f->len - f->off < FILE_SLICE ? f->len - f->off : FILE_SLICE;
+      if (read_full(f->fd, d.slice, n, f->off) != 0) {
+        status = SHA256_SOCK_EFILE;
+      } else {
+        sha256_update(&f->ctx, d.slice, n);
+        f->off += n;
+        if (f->off < f->len) {
+          d.files[kept++] = *f;
+          continue;
+        }
+      }
+    }
+    unsigned char digest[32];
+    sha256_final(&f->ctx, digest);
+    close(f->fd);
+    f->c->queued--;
+    // Also puts a dead connection on d.touched, where it is freed.
+    respond(f->c, f->id, status, status == SHA256_SOCK_OK ? digest : NULL);
+    d.requests++;
+  }
+  d.nfiles = kept;
+}
+
+static int listen_on(const char* path) {
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(addr.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  unlink(path);
+  if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 128) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int main(int argc, char** argv) {
+  const char* path = SHA256_SOCK_PATH;
+  int opt;
+
+  d.batch = 16;
+  d.cap = 1024;
+  d.max_inline = 1 << 20;
+  while ((opt = getopt(argc, argv, "s:b:q:m:")) != -1) {
+    switch (opt) {
+      case 's': path = optarg; break;
+      case 'b': d.batch = (uint32_t)atoi(optarg); break;
+      case 'q': d.cap = (uint32_t)atoi(optarg); break;
+      case 'm': d.max_inline = strtoull(optarg, NULL, 10); break;
+      default:
+        fprintf(stderr, "usage: %s [-s path] [-b batch] [-q queue] [-m max_inline]\n", argv[0]);
+        return 2;
+    }
+  }
+  if (d.batch == 0 || d.batch > MAX_BATCH) {
+    d.batch = MAX_BATCH;
+  }
+  if (d.cap == 0) {
+    d.cap = 1;
+  }
+  d.queue = malloc(d.cap * sizeof(request*));
+  d.slice = malloc(FILE_SLICE);
+
+  int lfd = listen_on(path);
+  d.ep = epoll_create1(EPOLL_CLOEXEC);
+  if (d.queue == NULL || d.slice == NULL || lfd < 0 || d.ep < 0) {
+    perror("sha256_sockd");
+    return 1;
+  }
+  struct epoll_event lev = { .events = EPOLLIN, .data.ptr = NULL };
+  epoll_ctl(d.ep, EPOLL_CTL_ADD, lfd, &lev);
+
+  struct sigaction sa = { .sa_handler = on_signal };
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+  signal(SIGPIPE, SIG_IGN);
+
+  struct epoll_event evs[64];
+  while (!stop) {
+    // With input still buffered or files part-hashed, only poll.
+    int nev = epoll_wait(d.ep, evs, 64, d.nstalled > 0 || d.nfiles > 0 ? 0 : -1);
+    if (nev < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("epoll_wait");
+      break;
+    }
+
+    // Entries that stall again are re-added at or below the current index.
+    uint32_t nstalled = d.nstalled;
+    d.nstalled = 0;
+    for (uint32_t i = 0; i < nstalled; i++) {
+      conn* c = d.stalled[i];
+      c->stalled = 0;
+      if (!c->dead) {
+        conn_read(c);
+      }
+      if (!c->touched) {
+        // Flushed, freed or re-armed with the others below.
+        conn_list_add(&d.touched, &d.ntouched, c);
+        c->touched = 1;
+      }
+    }
+
+    for (int i = 0; i < nev; i++) {
+      conn* c = evs[i].data.ptr;
+      if (c == NULL) {
+        int fd;
+        while ((fd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+          c = NULL;
+          if (conn_list_reserve(&d.touched, &d.touched_cap, d.nconns + 1) == 0 &&
+              conn_list_reserve(&d.stalled, &d.stalled_cap, d.nconns + 1) == 0) {
+            c = calloc(1, sizeof(*c));
+          }
+          if (c == NULL) {
+            close(fd);
+            continue;
+          }
+          d.nconns++;
+          c->fd = fd;
+          c->events = EPOLLIN;
+          struct epoll_event ev = { .events = EPOLLIN, .data.ptr = c };
+          epoll_ctl(d.ep, EPOLL_CTL_ADD, fd, &ev);
+        }
+        continue;
+      }
+      if (evs[i].events & EPOLLOUT) {
+        conn_flush(c);
+      }
+      if (evs[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        conn_read(c);
+      }
+      if (conn_finished(c)) {
+        conn_free(c);
+      } else {
+        conn_set_events(c);
+      }
+    }
+
+    hash_queue();
+    hash_files();
+
+    for (uint32_t i = 0; i < d.ntouched; i++) {
+      conn* c = d.touched[i];
+      c->touched = 0;
+      conn_flush(c);
+      if (conn_finished(c)) {
+        conn_free(c);
+      } else {
+        conn_set_events(c);
+      }
+    }
+    d.ntouched = 0;
+  }
+
+  fprintf(stderr, "sha256_sockd: %llu requests in %llu batches\n",
+          (unsigned long long)d.requests, (unsigned long long)d.batches);
+  unlink(path);
+  return 0;
+}
@@ -0,0 +1,98 @@
+/**
+ * sha2_engine.h - The SHA-2 round and padding code, generic over word size.
+ *
+ * SHA-256 and SHA-512 differ only in the word type, the number of rounds,
+ * the rotation amounts, the constants and the width of the length field.
+ * The macros below expand to static inline functions for one family, given
+ * those parameters: sha256_inline.h instantiates the 32-bit engine and
+ * sha512.c the 64-bit one.
+ *
+ * The SIMD kernels are not generated from here. SHA-NI exists only for
+ * 32-bit words, and the AVX2 multi-buffer kernels differ in lane count,
+ * element-size intrinsics and block transposes rather than in the rounds.
+ */
+#ifndef SHA2_ENGINE_H
+#define SHA2_ENGINE_H
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Portable kernel: name(H, blks, nblks) compresses nblks contiguous blocks
+ * into H, using a 16 word rolling message schedule. BSIG0/BSIG1/SSIG0/SSIG1,
+ * CH and MAJ are the family's round functions, load_be reads one word.
+ */
+#define SHA2_DEFINE_BLOCKS_SCALAR(name, word_t, nrounds, K, load_be,                 \
+                                  BSIG0, BSIG1, SSIG0, SSIG1, CH, MAJ)               \
+static inline void name(word_t H[8], const unsigned char* blks, uint64_t nblks) {    \
+  word_t W[16];                                                                      \
+  word_t a, b, c, d, e, f, g, h, T1, T2;                                             \
+                                                                                     \
+  for (uint64_t i = 0; i < nblks; i++, blks += 16 * sizeof(word_t)) {                \
+    for (int t = 0; t < 16; t++) {                                                   \
+      W[t] = load_be(blks + sizeof(word_t)*t);                                       \
+    }                                                                                \
+                                                                                     \
+    a = H[0];                                                                        \
+    b = H[1];                                                                        \
+    c = H[2];                                                                        \
+    d = H[3];                                                                        \
+    e = H[4];                                                                        \
+    f = H[5];                                                                        \
+    g = H[6];                                                                        \
+    h = H[7];                                                                        \
+                                                                                     \
+    for (int t = 0; t < (nrounds); t++) {                                            \
+      if (t >= 16) {                                                                 \
+        W[t&15] += SSIG1(W[(t-2)&15]) + W[(t-7)&15] + SSIG0(W[(t-15)&15]);           \
+      }                                                                              \
+      T1 = h + BSIG1(e) + CH(e,f,g) + K[t] + W[t&15];                                \
+      T2 = BSIG0(a) + MAJ(a,b,c);                                                    \
+      h = g;                                                                         \
+      g = f;                                                                         \
+      f = e;                                                                         \
+      e = d + T1;                                                                    \
+      d = c;                                                                         \
+      c = b;                                                                         \
+      b = a;                                                                         \
+      a = T1 + T2;                                                                   \
+    }                                                                                \
+                                                                                     \
+    H[0] += a;                                                                       \
+    H[1] += b;                                                                       \
+    H[2] += c;                                                                       \
+    H[3] += d;                                                                       \
+    H[4] += e;                                                                       \
+    H[5] += f;                                                                       \
+    H[6] += g;                                                                       \
+    H[7] += h;                                                                       \
+  }                                                                                  \
+}
+
+/*
+ * name(tail, rem, len) builds the padded final block(s) of a len byte
+ * message whose trailing (len % block) bytes start at rem, and returns the
+ * number of blocks, 1 or 2. The bit length goes big-endian into the last
+ * len_bytes bytes (8 for SHA-256, 16 for SHA-512); len is in bytes, so the
+ * bit length has at most 67 significant bits.
+ */
+#define SHA2_DEFINE_PAD_TAIL(name, block, len_bytes)                                 \
+static inline int name(unsigned char tail[2*(block)], const unsigned char* rem,      \
+                       uint64_t len) {                                               \
+  uint64_t r = len % (block);                                                        \
+  int n = (r < (block) - (len_bytes)) ? 1 : 2;                                       \
+  uint64_t bits = len << 3;                                                          \
+                                                                                     \
+  memcpy(tail, rem, r);                                                              \
+  tail[r] = 0x80;                                                                    \
+  memset(tail + r + 1, 0, n*(block) - (r+1));                                        \
+  for (int i = 1; i <= 8; i++, bits >>= 8) {                                         \
+    tail[n*(block) - i] = (unsigned char)bits;                                       \
+  }                                                                                  \
+  if ((len_bytes) > 8) {                                                             \
+    tail[n*(block) - 9] = (unsigned char)(len >> 61);                                \
+  }                                                                                  \
+  return n;                                                                          \
+}
+
+#endif /* SHA2_ENGINE_H */
@@ -0,0 +1,471 @@
+/**
+ * sha512.c - Implementation of the SHA-512 family (SHA-512, SHA-384,
+ * SHA-512/256).
+ *
+ * Same round structure as SHA-256 with 64-bit words, 80 rounds and 128 byte
+ * blocks: the portable kernel and the padding are the 64-bit instance of
+ * sha2_engine.h. The layout mirrors the fast path in sha256.c: variants are
+ * an IV plus a digest length, whole blocks are read in place and only the
+ * padded tail is built on the stack.
+ */
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SHA512_HAVE_AVX2 1
+#include <immintrin.h>
+#endif
+
+#include "sha2_engine.h"
+#include "sha512.h"
+
+#define SHA512_ROTR(x, n) (((x) >> (n)) | ((x) << (64-(n))))
+#define SHA512_CH(x, y, z) (((x) & (y)) ^ (~(x) & (z)))
+#define SHA512_MAJ(x, y, z) (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+#define SHA512_BSIG0(x) (SHA512_ROTR(x, 28) ^ SHA512_ROTR(x, 34) ^ SHA512_ROTR(x, 39))
+#define SHA512_BSIG1(x) (SHA512_ROTR(x, 14) ^ SHA512_ROTR(x, 18) ^ SHA512_ROTR(x, 41))
+#define SHA512_SSIG0(x) (SHA512_ROTR(x, 1) ^ SHA512_ROTR(x, 8) ^ ((x) >> 7))
+#define SHA512_SSIG1(x) (SHA512_ROTR(x, 19) ^ SHA512_ROTR(x, 61) ^ ((x) >> 6))
+
+/* SHA-512 constants */
+static const uint64_t K512[80] = {
+    0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL, 0xe9b5dba58189dbbcULL,
+    0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL, 0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL,
+    0xd807aa98a3030242ULL, 0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+    0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL, 0xc19bf174cf692694ULL,
+    0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL, 0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL,
+    0x2de92c6f592b0275ULL, 0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+    0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL, 0xbf597fc7beef0ee4ULL,
+    0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL, 0x06ca6351e003826fULL, 0x142929670a0e6e70ULL,
+    0x27b70a8546d22ffcULL, 0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+    0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL, 0x92722c851482353bULL,
+    0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL, 0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL,
+    0xd192e819d6ef5218ULL, 0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+    0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL, 0x34b0bcb5e19b48a8ULL,
+    0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL, 0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL,
+    0x748f82ee5defb2fcULL, 0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+    0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL, 0xc67178f2e372532bULL,
+    0xca273eceea26619cULL, 0xd186b8c721c0c207ULL, 0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL,
+    0x06f067aa72176fbaULL, 0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+    0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL, 0x431d67c49c100d4cULL,
+    0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL, 0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL
+};
+
+// Initial hash values.
+static const uint64_t H0_512[8] = {
+  0x6a09e667f3bcc908ULL,
+  0xbb67ae8584caa73bULL,
+  0x3c6ef372fe94f82bULL,
+  0xa54ff53a5f1d36f1ULL,
+  0x510e527fade682d1ULL,
+  0x9b05688c2b3e6c1fULL,
+  0x1f83d9abfb41bd6bULL,
+  0x5be0cd19137e2179ULL
+};
+
+static const uint64_t H0_384[8] = {
+  0xcbbb9d5dc1059ed8ULL,
+  0x629a292a367cd507ULL,
+  0x9159015a3070dd17ULL,
+  0x152fecd8f70e5939ULL,
+  0x67332667ffc00b31ULL,
+  0x8eb44a8768581511ULL,
+  0xdb0c2e0d64f98fa7ULL,
+  0x47b5481dbefa4fa4ULL
+};
+
+static const uint64_t H0_512_256[8] = {
+  0x22312194fc2bf72cULL,
+  0x9f555fa3c84c64c2ULL,
+  0x2393b86b6f53b151ULL,
+  0x963877195940eabdULL,
+  0x96283ee2a88effe3ULL,
+  0xbe5e1e2553863992ULL,
+  0x2b0199fc2c85b8aaULL,
+  0x0eb72ddc81c52ca2ULL
+};
+
+typedef struct {
+  const uint64_t* iv;
+  int digest_bytes;
+} sha512_variant;
+
+static const sha512_variant SHA512_VARIANT = { H0_512, 64 };
+static const sha512_variant SHA384_VARIANT = { H0_384, 48 };
+static const sha512_variant SHA512_256_VARIANT = { H0_512_256, 32 };
+
+static inline uint64_t load_be64(const unsigned char* p) {
+  uint64_t x = 0;
+  for (int i = 0; i < 8; i++) {
+    x = (x << 8) | p[i];
+  }
+  return x;
+}
+
+static inline void store_be64(unsigned char* p, uint64_t x) {
+  for (int i = 7; i >= 0; i--) {
+    p[i] = (unsigned char)x;
+    x >>= 8;
+  }
+}
+
+// Portable kernel: compress nblks contiguous 128 byte blocks into H.
+SHA2_DEFINE_BLOCKS_SCALAR(sha512_blocks_scalar, uint64_t, 80, K512, load_be64,
+                          SHA512_BSIG0, SHA512_BSIG1, SHA512_SSIG0, SHA512_SSIG1,
+                          SHA512_CH, SHA512_MAJ)
+
+// Build the padded final block(s) of a len byte message whose trailing
+// (len % 128) bytes start at rem. Returns the number of blocks, 1 or 2. The
+// bit length is stored as a 128-bit big-endian value.
+SHA2_DEFINE_PAD_TAIL(sha512_pad_tail, 128, 16)
+
+#ifdef SHA512_HAVE_AVX2
+/*
+ * 4-lane AVX2 kernel.
+ *
+ * Runs four independent messages through one block each, one 64-bit lane per
+ * message, with the state kept transposed as S[word][lane].
+ */
+#define ROTR_X4(x, n) _mm256_or_si256(_mm256_srli_epi64((x), (n)), _mm256_slli_epi64((x), 64-(n)))
+#define SIGMA0_X4(x) _mm256_xor_si256(_mm256_xor_si256(ROTR_X4(x, 28), ROTR_X4(x, 34)), ROTR_X4(x, 39))
+#define SIGMA1_X4(x) _mm256_xor_si256(_mm256_xor_si256(ROTR_X4(x, 14), ROTR_X4(x, 18)), ROTR_X4(x, 41))
+#define sigma0_X4(x) _mm256_xor_si256(_mm256_xor_si256(ROTR_X4(x, 1), ROTR_X4(x, 8)), _mm256_srli_epi64((x), 7))
+#define sigma1_X4(x) _mm256_xor_si256(_mm256_xor_si256(ROTR_X4(x, 19), ROTR_X4(x, 61)), _mm256_srli_epi64((x), 6))
+
+__attribute__((target("avx2")))
+static void sha512_x4_avx2(uint64_t S[8][4], const unsigned char* const blk[4]) {
+  const __m256i bswap = _mm256_setr_epi8(
+      7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+      7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+  __m256i W[16];
+
+  // Load four words of every lane at a time and transpose them so that
+  // W[t] holds word t of all four blocks.
+  for (int q = 0; q < 4; q++) {
+    __m256i r[4], t[4];
+    for (int l = 0; l < 4; l++) {
+      r[l] = _mm256_loadu_si256((const __m256i*)(blk[l] + 32*q));
+    }
+    t[0] = _mm256_unpacklo_epi64(r[0], r[1]);
+    t[1] = _mm256_unpackhi_epi64(r[0], r[1]);
+    t[2] = _mm256_unpacklo_epi64(r[2], r[3]);
+    t[3] = _mm256_unpackhi_epi64(r[2], r[3]);
+    W[4*q]   = _mm256_shuffle_epi8(_mm256_permute2x128_si256(t[0], t[2], 0x20), bswap);
+    W[4*q+1] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(t[1], t[3], 0x20), bswap);
+    W[4*q+2] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(t[0], t[2], 0x31), bswap);
+    W[4*q+3] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(t[1], t[3], 0x31), bswap);
+  }
+
+  __m256i a = _mm256_loadu_si256((const __m256i*)S[0]);
+  __m256i b = _mm256_loadu_si256((const __m256i*)S[1]);
+  __m256i c = _mm256_loadu_si256((const __m256i*)S[2]);
+  __m256i d = _mm256_loadu_si256((const __m256i*)S[3]);
+  __m256i e = _mm256_loadu_si256((const __m256i*)S[4]);
+  __m256i f = _mm256_loadu_si256((const __m256i*)S[5]);
+  __m256i g = _mm256_loadu_si256((const __m256i*)S[6]);
+  __m256i h = _mm256_loadu_si256((const __m256i*)S[7]);
+  __m256i T1, T2;
+
+  for (int t = 0; t < 80; t++) {
+    if (t >= 16) {
+      W[t&15] = _mm256_add_epi64(
+          _mm256_add_epi64(sigma1_X4(W[(t-2)&15]), W[(t-7)&15]),
+          _mm256_add_epi64(sigma0_X4(W[(t-15)&15]), W[t&15]));
+    }
+    T1 = _mm256_add_epi64(
+        _mm256_add_epi64(h, SIGMA1_X4(e)),
+        _mm256_add_epi64(
+            _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g)),
+            _mm256_add_epi64(_mm256_set1_epi64x((long long)K512[t]), W[t&15])));
+    T2 = _mm256_add_epi64(
+        SIGMA0_X4(a),
+        _mm256_xor_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_xor_si256(a, b))));
+    h = g;
+    g = f;
+    f = e;
+    e = _mm256_add_epi64(d, T1);
+    d = c;
+    c = b;
+    b = a;
+    a = _mm256_add_epi64(T1, T2);
+  }
+
+  _mm256_storeu_si256((__m256i*)S[0], _mm256_add_epi64(a, _mm256_loadu_si256((const __m256i*)S[0])));
+  _mm256_storeu_si256((__m256i*)S[1], _mm256_add_epi64(b, _mm256_loadu_si256((const __m256i*)S[1])));
+  _mm256_storeu_si256((__m256i*)S[2], _mm256_add_epi64(c, _mm256_loadu_si256((const __m256i*)S[2])));
+  _mm256_storeu_si256((__m256i*)S[3], _mm256_add_epi64(d, _mm256_loadu_si256((const __m256i*)S[3])));
+  _mm256_storeu_si256((__m256i*)S[4], _mm256_add_epi64(e, _mm256_loadu_si256((const __m256i*)S[4])));
+  _mm256_storeu_si256((__m256i*)S[5], _mm256_add_epi64(f, _mm256_loadu_si256((const __m256i*)S[5])));
+  _mm256_storeu_si256((__m256i*)S[6], _mm256_add_epi64(g, _mm256_loadu_si256((const __m256i*)S[6])));
+  _mm256_storeu_si256((__m256i*)S[7], _mm256_add_epi64(h, _mm256_loadu_si256((const __m256i*)S[7])));
+}
+
+static int cpu_has_avx2(void) {
+  static int has = -1;
+  if (has < 0) {
+    __builtin_cpu_init();
+    has = __builtin_cpu_supports("avx2") ? 1 : 0;
+  }
+  return has;
+}
+#endif /* SHA512_HAVE_AVX2 */
+
+void sha512_compress(uint64_t state[8], const unsigned char* blocks, uint64_t nblocks) {
+  sha512_blocks_scalar(state, blocks, nblocks);
+}
+
+void sha512_compress_batch(uint64_t (*states)[8], const unsigned char* const* blocks,
+                           uint64_t nblocks, uint64_t n) {
+  uint64_t i = 0;
+
+#ifdef SHA512_HAVE_AVX2
+  if (cpu_has_avx2()) {
+    uint64_t S[8][4];
+    const unsigned char* blk[4];
+
+    for (; i + 4 <= n; i += 4) {
+      for (int l = 0; l < 4; l++) {
+        blk[l] = blocks[i+l];
+        for (int w = 0; w < 8; w++) {
+          S[w][l] = states[i+l][w];
+        }
+      }
+      for (uint64_t k = 0; k < nblocks; k++) {
+        sha512_x4_avx2(S, blk);
+        for (int l = 0; l < 4; l++) {
+          blk[l] += 128;
+        }
+      }
+      for (int l = 0; l < 4; l++) {
+        for (int w = 0; w < 8; w++) {
+          states[i+l][w] = S[w][l];
+        }
+      }
+    }
+  }
+#endif
+
+  for (; i < n; i++) {
+    sha512_compress(states[i], blocks[i], nblocks);
+  }
+}
+
+static void sha512_store_digest(const sha512_variant* v, unsigned char* digest,
+                                const uint64_t H[8]) {
+  unsigned char full[64];
+  for (int i = 0; i < 8; i++) {
+    store_be64(full + 8*i, H[i]);
+  }
+  memcpy(digest, full, v->digest_bytes);
+}
+
+static void sha512_oneshot(const sha512_variant* v, const unsigned char* msg, uint64_t len,
+                           unsigned char* digest) {
+  uint64_t H[8];
+  unsigned char tail[256];
+
+  memcpy(H, v->iv, sizeof(H));
+  sha512_compress(H, msg, len / 128);
+  int ntail = sha512_pad_tail(tail, msg + (len - len % 128), len);
+  sha512_compress(H, tail, ntail);
+  sha512_store_digest(v, digest, H);
+}
+
+void sha512_hash(const unsigned char* msg, uint64_t len, unsigned char digest[64]) {
+  sha512_oneshot(&SHA512_VARIANT, msg, len, digest);
+}
+
+void sha384_hash(const unsigned char* msg, uint64_t len, unsigned char digest[48]) {
+  sha512_oneshot(&SHA384_VARIANT, msg, len, digest);
+}
+
+void sha512_256_hash(const unsigned char* msg, uint64_t len, unsigned char digest[32]) {
+  sha512_oneshot(&SHA512_256_VARIANT, msg, len, digest);
+}
+
+static void sha512_ctx_init(sha512_ctx* ctx, const sha512_variant* v) {
+  memcpy(ctx->H, v->iv, sizeof(ctx->H));
+  ctx->len = 0;
+  ctx->buflen = 0;
+  ctx->digest_bytes = v->digest_bytes;
+}
+
+void sha512_init(sha512_ctx* ctx) {
+  sha512_ctx_init(ctx, &SHA512_VARIANT);
+}
+
+void sha384_init(sha512_ctx* ctx) {
+  sha512_ctx_init(ctx, &SHA384_VARIANT);
+}
+
+void sha512_256_init(sha512_ctx* ctx) {
+  sha512_ctx_init(ctx, &SHA512_256_VARIANT);
+}
+
+void sha512_update(sha512_ctx* ctx, const unsigned char* data, uint64_t len) {
+  ctx->len += len;
+
+  // Top up a partial block first.
+  if (ctx->buflen > 0) {
+    uint64_t take = 128 - ctx->buflen < len ? 128 - ctx->buflen : len;
+    memcpy(ctx->buf + ctx->buflen, data, take);
+    ctx->buflen += take;
+    data += take;
+    len -= take;
+    if (ctx->buflen < 128) {
+      return;
+    }
+    sha512_compress(ctx->H, ctx->buf, 1);
+    ctx->buflen = 0;
+  }
+
+  if (len >= 128) {
+    sha512_compress(ctx->H, data, len / 128);
+    data += len - len % 128;
+    len %= 128;
+  }
+
+  memcpy(ctx->buf, data, len);
+  ctx->buflen = len;
+}
+
+void sha512_final(const sha512_ctx* ctx, unsigned char* digest) {
+  uint64_t H[8];
+  unsigned char tail[256];
+  sha512_variant v = { NULL, (int)ctx->digest_bytes };
+
+  memcpy(H, ctx->H, sizeof(H));
+  int ntail = sha512_pad_tail(tail, ctx->buf, ctx->len);
+  sha512_compress(H, tail, ntail);
+  sha512_store_digest(&v, digest, H);
+}
+
+#ifdef SHA512_HAVE_AVX2
+/*
+ * Lane scheduler for the 4-lane kernel, as in sha256.c: a lane walks one
+ * message, its whole blocks in place and then its padded tail, and is
+ * refilled with the next message when it finishes.
+ */
+typedef struct {
+  const unsigned char* next;   // next whole block, in the caller's buffer
+  uint64_t nfull;              // whole blocks left
+  unsigned char tail[256];     // padded final block(s)
+  int ntail;                   // number of padded blocks
+  int tailpos;                 // padded blocks already consumed
+  int active;
+  uint64_t msg;
+} sha512_lane;
+
+static void sha512_lane_start(sha512_lane* ln, const unsigned char* msg, uint64_t len,
+                              uint64_t i) {
+  ln->next = msg;
+  ln->nfull = len / 128;
+  ln->ntail = sha512_pad_tail(ln->tail, msg + (len - len % 128), len);
+  ln->tailpos = 0;
+  ln->active = 1;
+  ln->msg = i;
+}
+
+static const unsigned char* sha512_lane_block(sha512_lane* ln) {
+  if (ln->nfull > 0) {
+    const unsigned char* p = ln->next;
+    ln->next += 128;
+    ln->nfull--;
+    return p;
+  }
+  return ln->tail + 128 * ln->tailpos++;
+}
+
+static int sha512_lane_done(const sha512_lane* ln) {
+  return ln->nfull == 0 && ln->tailpos == ln->ntail;
+}
+
+// Hash messages [0, n), n >= 4, through the 4-lane kernel.
+static void sha512_batch_x4(const sha512_variant* v, const unsigned char* const* msgs,
+                            const uint64_t* lens, uint64_t n, unsigned char* const* digests) {
+  uint64_t S[8][4];
+  sha512_lane lanes[4];
+  const unsigned char* blk[4];
+  uint64_t next = 0;
+
+  for (int l = 0; l < 4; l++, next++) {
+    sha512_lane_start(&lanes[l], msgs[next], lens[next], next);
+    for (int w = 0; w < 8; w++) {
+      S[w][l] = v->iv[w];
+    }
+  }
+
+  // Run all four lanes until one finishes with no message left to refill it.
+  int full = 1;
+  while (full) {
+    for (int l = 0; l < 4; l++) {
+      blk[l] = sha512_lane_block(&lanes[l]);
+    }
+    sha512_x4_avx2(S, blk);
+
+    for (int l = 0; l < 4; l++) {
+      if (!sha512_lane_done(&lanes[l])) {
+        continue;
+      }
+      uint64_t H[8];
+      for (int w = 0; w < 8; w++) {
+        H[w] = S[w][l];
+      }
+      sha512_store_digest(v, digests[lanes[l].msg], H);
+      if (next < n) {
+        sha512_lane_start(&lanes[l], msgs[next], lens[next], next);
+        for (int w = 0; w < 8; w++) {
+          S[w][l] = v->iv[w];
+        }
+        next++;
+      } else {
+        lanes[l].active = 0;
+        full = 0;
+      }
+    }
+  }
+
+  // Finish the lanes still in flight one at a time.
+  for (int l = 0; l < 4; l++) {
+    sha512_lane* ln = &lanes[l];
+    if (!ln->active) {
+      continue;
+    }
+    uint64_t H[8];
+    for (int w = 0; w < 8; w++) {
+      H[w] = S[w][l];
+    }
+    sha512_compress(H, ln->next, ln->nfull);
+    sha512_compress(H, ln->tail + 128*ln->tailpos, ln->ntail - ln->tailpos);
+    sha512_store_digest(v, digests[ln->msg], H);
+  }
+}
+#endif /* SHA512_HAVE_AVX2 */
+
+static void sha512_batch(const sha512_variant* v, const unsigned char* const* msgs,
+                         const uint64_t* lens, uint64_t n, unsigned char* const* digests) {
+#ifdef SHA512_HAVE_AVX2
+  if (n >= 4 && cpu_has_avx2()) {
+    sha512_batch_x4(v, msgs, lens, n, digests);
+    return;
+  }
+#endif
+  for (uint64_t i = 0; i < n; i++) {
+    sha512_oneshot(v, msgs[i], lens[i], digests[i]);
+  }
+}
+
+void sha512_hash_batch(const unsigned char* const* msgs, const uint64_t* lens, uint64_t n,
+                       unsigned char* const* digests) {
+  sha512_batch(&SHA512_VARIANT, msgs, lens, n, digests);
+}
+
+void sha384_hash_batch(const unsigned char* const* msgs, const uint64_t* lens, uint64_t n,
+                       unsigned char* const* digests) {
+  sha512_batch(&SHA384_VARIANT, msgs, lens, n, digests);
+}
+
+void sha512_256_hash_batch(const unsigned char* const* msgs, const uint64_t* lens, uint64_t n,
+                           unsigned char* const* digests) {
+  sha512_batch(&SHA512_256_VARIANT, msgs, lens, n, digests);
+}
@@ -0,0 +1,76 @@
+/**
+ * sha512.h - Public interface of the SHA-512 family in sha512.c.
+ */
+#ifndef SHA512_H
+#define SHA512_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * One-shot hashing.
+ *
+ * SHA-384 and SHA-512/256 are SHA-512 started from their own IVs with the
+ * digest cut to 48 and 32 bytes. On 64-bit hosts without SHA-NI, SHA-512/256
+ * usually beats SHA-256 per byte on large inputs.
+ */
+void sha512_hash(const unsigned char* msg, uint64_t len, unsigned char digest[64]);
+void sha384_hash(const unsigned char* msg, uint64_t len, unsigned char digest[48]);
+void sha512_256_hash(const unsigned char* msg, uint64_t len, unsigned char digest[32]);
+
+/*
+ * Streaming hashing, as with sha256_ctx: the context holds no pointers, so
+ * copying it forks the midstate, and sha512_final() leaves it untouched.
+ * sha512_final() writes 64 bytes, 48 after sha384_init() or 32 after
+ * sha512_256_init().
+ */
+typedef struct {
+  uint64_t H[8];
+  uint64_t len;              // bytes absorbed so far
+  unsigned char buf[128];    // pending partial block
+  uint32_t buflen;
+  uint32_t digest_bytes;
+} sha512_ctx;
+
+void sha512_init(sha512_ctx* ctx);
+void sha384_init(sha512_ctx* ctx);
+void sha512_256_init(sha512_ctx* ctx);
+void sha512_update(sha512_ctx* ctx, const unsigned char* data, uint64_t len);
+void sha512_final(const sha512_ctx* ctx, unsigned char* digest);
+
+/*
+ * Hash n independent messages, msgs[i] of lens[i] bytes, into digests[i].
+ * With four or more messages and an AVX2 CPU they run through the 4-lane
+ * kernel, each lane taking the next message as soon as its own finishes.
+ */
+void sha512_hash_batch(const unsigned char* const* msgs, const uint64_t* lens, uint64_t n,
+                       unsigned char* const* digests);
+void sha384_hash_batch(const unsigned char* const* msgs, const uint64_t* lens, uint64_t n,
+                       unsigned char* const* digests);
+void sha512_256_hash_batch(const unsigned char* const* msgs, const uint64_t* lens, uint64_t n,
+                           unsigned char* const* digests);
+
+/*
+ * Compression function.
+ *
+ * Run nblocks contiguous 128 byte blocks through the SHA-512 compression
+ * function, chaining from state. No padding is applied.
+ */
+void sha512_compress(uint64_t state[8], const unsigned char* blocks, uint64_t nblocks);
+
+/*
+ * Batched compression over n independent states: states[i] absorbs nblocks
+ * contiguous blocks starting at blocks[i]. Groups of four run through the
+ * 4-lane AVX2 kernel when the CPU has it.
+ */
+void sha512_compress_batch(uint64_t (*states)[8], const unsigned char* const* blocks,
+                           uint64_t nblocks, uint64_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SHA512_H */
@@ -5,6 +5,10 @@ possible.
 """
 from __future__ import annotations
 from hashlib import sha256  # For testing.
+import resource
+import struct
+import sys
+import time
 
 # Constant parameters for SHA-256
 BLOCK_SIZE = 512
@@ -119,7 +123,7 @@ def pad_message(M: bytes) -> bytes:
     padded_msg |= (1 << (k+64))  # Add the 1
     padded_msg |= l              # Add l to the end.
 
-    msglen = k + l + 1 + 448
+    msglen = l + 1 + k + 64
     return padded_msg.to_bytes(msglen//8, 'big')
 
 def parse_msg_blocks(padded_msg: bytes) -> list[bytes]:
@@ -131,15 +135,8 @@ def parse_msg_blocks(padded_msg: bytes) -> list[bytes]:
     # Get the number of message blocks to parse, N
     N = ((len(padded_msg)*8) // 512)
     
-    # Parse each message block.
-    padded_msg = int.from_bytes(padded_msg, 'big')
-    msg_blocks = []
-    for i in range(N):
-        blk = (padded_msg & (2**512 - 1)).to_bytes(512//8, 'big')
-        msg_blocks.insert(0, blk)
-        padded_msg = padded_msg >> 512
-
-    return msg_blocks
+    # Parse each message block, first to last.
+    return [padded_msg[i*64:(i+1)*64] for i in range(N)]
 
 
 # initial hash value
@@ -176,7 +173,7 @@ def sha256_hash_computation(msg_blocks: list[bytes]) -> int:
     """Given the message blocks, return the SHA-256 digest.
     """
     N = len(msg_blocks)
-    H = H0
+    H = list(H0)  # Copy, so H0 stays intact for the next message.
     for i in range(N):
         Mi = int.from_bytes(msg_blocks[i], 'big')
         # Prepare the message schedule.
@@ -240,7 +237,146 @@ def my_sha256(msg: bytes) -> int:
     digest = sha256_hash_computation(msg_blocks)
     return digest
 
+
+# STREAMING IMPLEMENTATION
+# The functions above follow the spec step by step and hold the whole padded
+# message in memory. SHA256 below computes the same digest in one pass over
+# 64-byte blocks, with the helper functions inlined, so it runs in linear time
+# and constant memory on inputs of any size.
+
+_K = tuple(K)
+_BLOCK = struct.Struct('>16I')
+_STATE = struct.Struct('>8I')
+_LENGTH = struct.Struct('>Q')
+
+
+def _compress(H: list[int], buf, offset: int) -> None:
+    """Apply the compression function to the 64-byte block at buf[offset:].
+
+    :param H: Hash value of 8 32-bit words, updated in place.
+    :param buf: Bytes-like object holding the block.
+    :param offset: Start of the block within buf.
+    """
+    W = list(_BLOCK.unpack_from(buf, offset))
+    for t in range(16, 64):
+        x = W[t-15]
+        y = W[t-2]
+        s0 = (x >> 7 | x << 25) ^ (x >> 18 | x << 14) ^ (x >> 3)
+        s1 = (y >> 17 | y << 15) ^ (y >> 19 | y << 13) ^ (y >> 10)
+        W.append((W[t-16] + s0 + W[t-7] + s1) & WORD_MASK)
+
+    a, b, c, d, e, f, g, h = H
+    for Kt, Wt in zip(_K, W):
+        T1 = (h + ((e >> 6 | e << 26) ^ (e >> 11 | e << 21) ^ (e >> 25 | e << 7))
+              + (g ^ (e & (f ^ g))) + Kt + Wt) & WORD_MASK
+        T2 = ((a >> 2 | a << 30) ^ (a >> 13 | a << 19) ^ (a >> 22 | a << 10)) \
+           + ((a & b) | (c & (a | b)))
+        h = g
+        g = f
+        f = e
+        e = (d + T1) & WORD_MASK
+        d = c
+        c = b
+        b = a
+        a = (T1 + T2) & WORD_MASK
+
+    H[0] = (H[0] + a) & WORD_MASK
+    H[1] = (H[1] + b) & WORD_MASK
+    H[2] = (H[2] + c) & WORD_MASK
+    H[3] = (H[3] + d) & WORD_MASK
+    H[4] = (H[4] + e) & WORD_MASK
+    H[5] = (H[5] + f) & WORD_MASK
+    H[6] = (H[6] + g) & WORD_MASK
+    H[7] = (H[7] + h) & WORD_MASK
+
+
+class SHA256:
+    """Incremental SHA-256 with the hashlib interface.
+
+        h = SHA256()
+        for chunk in chunks:
+            h.update(chunk)
+        h.hexdigest()
+    """
+    name = 'sha256'
+    digest_size = 32
+    block_size = 64
+
+    def __init__(self, data=b''):
+        self._H = list(H0)
+        self._buf = bytearray()  # Fewer than 64 bytes not yet compressed.
+        self._len = 0
+        if data:
+            self.update(data)
+
+    def update(self, data) -> None:
+        """Hash more of the message.
+
+        :param data: Any bytes-like object; it is read in place.
+        """
+        mv = memoryview(data).cast('B')
+        n = len(mv)
+        self._len += n
+        i = 0
+        if self._buf:
+            i = min(64 - len(self._buf), n)
+            self._buf += mv[:i]
+            if len(self._buf) < 64:
+                return
+            _compress(self._H, self._buf, 0)
+            self._buf.clear()
+        H = self._H
+        end = i + (n - i) // 64 * 64
+        for off in range(i, end, 64):
+            _compress(H, mv, off)
+        self._buf += mv[end:]
+
+    def copy(self) -> SHA256:
+        c = SHA256()
+        c._H = list(self._H)
+        c._buf = bytearray(self._buf)
+        c._len = self._len
+        return c
+
+    def digest(self) -> bytes:
+        """Digest of the data so far; the object can still be updated."""
+        H = list(self._H)
+        tail = self._buf + b'\x80' + bytes((55 - len(self._buf)) % 64) \
+             + _LENGTH.pack((self._len * 8) & 0xFFFFFFFFFFFFFFFF)
+        for off in range(0, len(tail), 64):
+            _compress(H, tail, off)
+        return _STATE.pack(*H)
+
+    def hexdigest(self) -> str:
+        return self.digest().hex()
+
+
+def bench(sizes_mb: list[int]) -> None:
+    """Time SHA256 and hashlib over inputs streamed in 64 KiB chunks.
+
+    :param sizes_mb: Input sizes in MB.
+    """
+    chunk = bytes(range(256)) * 256
+    for mb in sizes_mb:
+        n = mb * 1000000 // len(chunk)
+        ref = sha256()
+        mine = SHA256()
+        t0 = time.perf_counter()
+        for _ in range(n):
+            mine.update(chunk)
+        got = mine.hexdigest()
+        dt = time.perf_counter() - t0
+        for _ in range(n):
+            ref.update(chunk)
+        assert got == ref.hexdigest(), mb
+        rss = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss / 1024
+        print(f"{n*len(chunk)/1e6:8.1f} MB {dt:9.2f} s {n*len(chunk)/dt/1e6:7.3f} MB/s"
+              f"  max RSS {rss:.1f} MB")
+
 def main():
+    if len(sys.argv) > 1 and sys.argv[1] == '--bench':
+        bench([int(mb) for mb in sys.argv[2:]] or [1, 10, 100])
+        return
     message = b'abc'
     print("PADDED:", pad_message(message));
     my_digest = my_sha256(message)
@@ -0,0 +1,89 @@
+"""rows.py - Hash every row of a record array in one call to the C kernels.
+
+    from rows import hash_rows
+    digests = hash_rows(records)            # (N, W) uint8 array -> (N, 32)
+    digests = hash_rows(data, offsets)      # Arrow-style column -> (N, 32)
+
+The rows go to fastsha256.hash_rows() (see sha256module.c) as one buffer, so
+there is no per-row Python work. The result is an (N, 32) uint8 NumPy array
+when NumPy is installed, else a memoryview of the same shape.
+
+    python3 rows.py [nrows] [width]         # benchmark against hashlib and main.py
+"""
+from __future__ import annotations
+from array import array
+import hashlib
+import sys
+import time
+
+import fastsha256
+
+try:
+    import numpy as np
+except ImportError:
+    np = None
+
+
+def hash_rows(data, offsets=None, width: int = 0):
+    """SHA-256 of every row.
+
+    :param data: (N, W) uint8 array of fixed-width records, an (N,) structured
+        array (each record's bytes are one row), a flat buffer with width, or
+        the data buffer of a string column when offsets is given.
+    :param offsets: N+1 int32 or int64 row boundaries into data.
+    :param width: Record width for a flat buffer.
+    :return: (N, 32) uint8 array of digests.
+    :raises TypeError: for any other NumPy dtype, whose values would not fit
+        in bytes; hash their raw bytes with data.view(np.uint8).
+    """
+    if np is not None and isinstance(data, np.ndarray):
+        if data.dtype.fields is not None and data.ndim == 1:
+            data = np.ascontiguousarray(data).view(np.uint8).reshape(len(data), -1)
+        elif data.dtype != np.uint8:
+            raise TypeError(f"hash_rows needs uint8 data, not {data.dtype}; "
+                            "use data.view(np.uint8) to hash the raw bytes")
+        else:
+            data = np.ascontiguousarray(data)
+    if isinstance(offsets, (list, tuple)):
+        offsets = array('q', offsets)
+    if offsets is None:
+        out = fastsha256.hash_rows(data, width=width)
+    else:
+        out = fastsha256.hash_rows(data, offsets)
+    if np is not None:
+        return np.frombuffer(out, dtype=np.uint8).reshape(-1, 32)
+    return memoryview(out).cast('B', (len(out) // 32, 32))
+
+
+def bench(label: str, fn, nrows: int, width: int):
+    t0 = time.perf_counter()
+    fn()
+    dt = time.perf_counter() - t0
+    print(f"{label:<22} {nrows:>9} rows {dt*1e3:10.2f} ms "
+          f"{nrows/dt/1e6:9.3f} Mrows/s {nrows*width/dt/1e6:9.1f} MB/s")
+
+
+def main():
+    nrows = int(sys.argv[1]) if len(sys.argv) > 1 else 1 << 20
+    width = int(sys.argv[2]) if len(sys.argv) > 2 else 64
+    flat = bytes((i * 131 + (i >> 8)) & 0xFF for i in range(nrows * width))
+    data = np.frombuffer(flat, dtype=np.uint8).reshape(nrows, width) if np else flat
+    rows = [flat[i*width:(i+1)*width] for i in range(nrows)]
+
+    got = bytes(hash_rows(data, width=0 if np else width))
+    want = b''.join(hashlib.sha256(r).digest() for r in rows)
+    assert got == want, "hash_rows disagrees with hashlib"
+
+    print(f"# {nrows} rows of {width} bytes, numpy {'yes' if np else 'no (memoryview)'}")
+    bench("hash_rows", lambda: hash_rows(data, width=0 if np else width), nrows, width)
+    bench("hash_batch", lambda: fastsha256.hash_batch(rows), nrows, width)
+    bench("hashlib loop", lambda: [hashlib.sha256(r).digest() for r in rows], nrows, width)
+
+    # The pure-Python reference is orders of magnitude slower; time a slice.
+    from main import my_sha256
+    few = rows[:min(nrows, 2000)]
+    bench("my_sha256 loop", lambda: [my_sha256(r) for r in few], len(few), width)
+
+
+if __name__ == '__main__':
+    main()
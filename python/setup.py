@@ -0,0 +1,15 @@
+"""setup.py - Build the fastsha256 extension against the C engine in ../c.
+
+    python3 setup.py build_ext --inplace
+"""
+from setuptools import setup, Extension
+
+fastsha256 = Extension(
+    'fastsha256',
+    sources=['sha256module.c', '../c/sha256.c'],
+    include_dirs=['../c'],
+    define_macros=[('SHA256_NO_MAIN', None)],
+    extra_compile_args=['-O2'],
+)
+
+setup(name='fastsha256', version='0.1', ext_modules=[fastsha256])
@@ -0,0 +1,444 @@
+/**
+ * sha256module.c - CPython extension over the C engine in ../c/sha256.c.
+ *
+ *   python3 setup.py build_ext --inplace
+ *
+ *   import fastsha256
+ *   h = fastsha256.sha256(b"abc")
+ *   h.update(buf)
+ *   h.hexdigest()
+ *   fastsha256.hash_batch([b"a", b"bc"])        # list of 32-byte digests
+ *   fastsha256.hash_rows(records)               # rows of a 2-D uint8 array
+ *   fastsha256.hash_rows(data, offsets)         # Arrow-style string column
+ *
+ * hash_rows() returns one bytes object of nrows*32 digests from a single
+ * sha256_column64()/sha256_column() call; see rows.py for the NumPy view.
+ *
+ * sha256() and sha224() objects behave like hashlib's: update(), copy(),
+ * digest(), hexdigest(), name, digest_size and block_size. Input is any
+ * object with the buffer protocol and is read in place. Inputs of at least
+ * FASTSHA256_GIL_MINSIZE bytes are hashed with the GIL released, so Python
+ * threads hash in parallel; an object shared between threads is then
+ * guarded by its own lock, as in hashlib.
+ */
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <pythread.h>
+
+#include "sha256.h"
+
+#define FASTSHA256_GIL_MINSIZE 2048
+
+typedef struct {
+  PyObject_HEAD
+  sha256_ctx ctx;
+  int sha224;
+  PyThread_type_lock lock;    // created by the first update that drops the GIL
+} ShaObject;
+
+static PyTypeObject ShaType;
+
+// Take the object's lock, if it has one, without stalling other threads.
+static void sha_enter(ShaObject* self) {
+  if (self->lock != NULL && !PyThread_acquire_lock(self->lock, 0)) {
+    Py_BEGIN_ALLOW_THREADS
+    PyThread_acquire_lock(self->lock, 1);
+    Py_END_ALLOW_THREADS
+  }
+}
+
+static void sha_leave(ShaObject* self) {
+  if (self->lock != NULL) {
+    PyThread_release_lock(self->lock);
+  }
+}
+
+static int get_buffer(PyObject* obj, Py_buffer* view) {
+  if (PyUnicode_Check(obj)) {
+    PyErr_SetString(PyExc_TypeError, "Strings must be encoded before hashing");
+    return -1;
+  }
+  return PyObject_GetBuffer(obj, view, PyBUF_SIMPLE);
+}
+
+static int sha_update_buffer(ShaObject* self, PyObject* obj) {
+  Py_buffer view;
+  if (get_buffer(obj, &view) < 0) {
+    return -1;
+  }
+  if (self->lock == NULL && view.len >= FASTSHA256_GIL_MINSIZE) {
+    self->lock = PyThread_allocate_lock();   // on failure, keep the GIL
+  }
+  if (self->lock != NULL && view.len >= FASTSHA256_GIL_MINSIZE) {
+    Py_BEGIN_ALLOW_THREADS
+    PyThread_acquire_lock(self->lock, 1);
+    sha256_update(&self->ctx, view.buf, (uint64_t)view.len);
+    PyThread_release_lock(self->lock);
+    Py_END_ALLOW_THREADS
+  } else {
+    sha_enter(self);
+    sha256_update(&self->ctx, view.buf, (uint64_t)view.len);
+    sha_leave(self);
+  }
+  PyBuffer_Release(&view);
+  return 0;
+}
+
+static ShaObject* sha_new(int sha224) {
+  ShaObject* self = PyObject_New(ShaObject, &ShaType);
+  if (self == NULL) {
+    return NULL;
+  }
+  self->sha224 = sha224;
+  self->lock = NULL;
+  if (sha224) {
+    sha224_init(&self->ctx);
+  } else {
+    sha256_init(&self->ctx);
+  }
+  return self;
+}
+
+static void sha_dealloc(ShaObject* self) {
+  if (self->lock != NULL) {
+    PyThread_free_lock(self->lock);
+  }
+  PyObject_Free(self);
+}
+
+static PyObject* sha_update(ShaObject* self, PyObject* obj) {
+  if (sha_update_buffer(self, obj) < 0) {
+    return NULL;
+  }
+  Py_RETURN_NONE;
+}
+
+static PyObject* sha_copy(ShaObject* self, PyObject* unused) {
+  (void)unused;
+  ShaObject* c = sha_new(self->sha224);
+  if (c == NULL) {
+    return NULL;
+  }
+  sha_enter(self);
+  c->ctx = self->ctx;
+  sha_leave(self);
+  return (PyObject*)c;
+}
+
+static int sha_size(const ShaObject* self) {
+  return self->sha224 ? 28 : 32;
+}
+
+static PyObject* sha_digest(ShaObject* self, PyObject* unused) {
+  (void)unused;
+  unsigned char d[32];
+  sha_enter(self);
+  sha256_final(&self->ctx, d);
+  sha_leave(self);
+  return PyBytes_FromStringAndSize((const char*)d, sha_size(self));
+}
+
+static PyObject* sha_hexdigest(ShaObject* self, PyObject* unused) {
+  (void)unused;
+  static const char hex[] = "0123456789abcdef";
+  unsigned char d[32];
+  char s[64];
+  sha_enter(self);
+  sha256_final(&self->ctx, d);
+  sha_leave(self);
+  for (int i = 0; i < sha_size(self); i++) {
+    s[2*i] = hex[d[i] >> 4];
+    s[2*i+1] = hex[d[i] & 15];
+  }
+  return PyUnicode_FromStringAndSize(s, 2 * sha_size(self));
+}
+
+static PyObject* sha_get_name(ShaObject* self, void* closure) {
+  (void)closure;
+  return PyUnicode_FromString(self->sha224 ? "sha224" : "sha256");
+}
+
+static PyObject* sha_get_digest_size(ShaObject* self, void* closure) {
+  (void)closure;
+  return PyLong_FromLong(sha_size(self));
+}
+
+static PyObject* sha_get_block_size(ShaObject* self, void* closure) {
+  (void)self;
+  (void)closure;
+  return PyLong_FromLong(64);
+}
+
+static PyMethodDef sha_methods[] = {
+  { "update", (PyCFunction)sha_update, METH_O, "Feed bytes-like data into the hash." },
+  { "copy", (PyCFunction)sha_copy, METH_NOARGS, "Return a copy of the hash object." },
+  { "digest", (PyCFunction)sha_digest, METH_NOARGS, "Return the digest as bytes." },
+  { "hexdigest", (PyCFunction)sha_hexdigest, METH_NOARGS, "Return the digest as hex." },
+  { NULL, NULL, 0, NULL },
+};
+
+static PyGetSetDef sha_getset[] = {
+  { "name", (getter)sha_get_name, NULL, NULL, NULL },
+  { "digest_size", (getter)sha_get_digest_size, NULL, NULL, NULL },
+  { "block_size", (getter)sha_get_block_size, NULL, NULL, NULL },
+  { NULL, NULL, NULL, NULL, NULL },
+};
+
+static PyTypeObject ShaType = {
+  PyVarObject_HEAD_INIT(NULL, 0)
+  .tp_name = "fastsha256.SHA256Type",
+  .tp_basicsize = sizeof(ShaObject),
+  .tp_dealloc = (destructor)sha_dealloc,
+  .tp_flags = Py_TPFLAGS_DEFAULT,
+  .tp_methods = sha_methods,
+  .tp_getset = sha_getset,
+};
+
+// sha256(data=b'', *, usedforsecurity=True), and the same for sha224.
+static PyObject* new_hash(PyObject* args, PyObject* kwargs, int sha224) {
+  static char* kwlist[] = { "data", "usedforsecurity", NULL };
+  PyObject* data = NULL;
+  int usedforsecurity = 1;
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O$p", kwlist, &data, &usedforsecurity)) {
+    return NULL;
+  }
+  ShaObject* self = sha_new(sha224);
+  if (self != NULL && data != NULL && sha_update_buffer(self, data) < 0) {
+    Py_DECREF(self);
+    return NULL;
+  }
+  return (PyObject*)self;
+}
+
+static PyObject* mod_sha256(PyObject* module, PyObject* args, PyObject* kwargs) {
+  (void)module;
+  return new_hash(args, kwargs, 0);
+}
+
+static PyObject* mod_sha224(PyObject* module, PyObject* args, PyObject* kwargs) {
+  (void)module;
+  return new_hash(args, kwargs, 1);
+}
+
+// hash_batch(messages) -> list of digests, one sha256_hash_batch() call.
+static PyObject* mod_hash_batch(PyObject* module, PyObject* arg) {
+  (void)module;
+  PyObject* seq = PySequence_Fast(arg, "hash_batch() takes a sequence of bytes-like objects");
+  if (seq == NULL) {
+    return NULL;
+  }
+  Py_ssize_t n = PySequence_Fast_GET_SIZE(seq);
+  Py_buffer* views = PyMem_Calloc(n ? n : 1, sizeof(Py_buffer));
+  const unsigned char** msgs = PyMem_Calloc(n ? n : 1, sizeof(*msgs));
+  uint64_t* lens = PyMem_Calloc(n ? n : 1, sizeof(*lens));
+  unsigned char** outs = PyMem_Calloc(n ? n : 1, sizeof(*outs));
+  unsigned char* digests = PyMem_Malloc(n ? 32 * n : 1);
+  PyObject* result = NULL;
+  Py_ssize_t got = 0;
+  uint64_t total = 0;
+
+  if (views == NULL || msgs == NULL || lens == NULL || outs == NULL || digests == NULL) {
+    PyErr_NoMemory();
+    goto done;
+  }
+  for (; got < n; got++) {
+    if (get_buffer(PySequence_Fast_GET_ITEM(seq, got), &views[got]) < 0) {
+      goto done;
+    }
+    msgs[got] = views[got].buf;
+    lens[got] = (uint64_t)views[got].len;
+    outs[got] = digests + 32 * got;
+    total += lens[got];
+  }
+
+  if (total >= FASTSHA256_GIL_MINSIZE) {
+    Py_BEGIN_ALLOW_THREADS
+    sha256_hash_batch(msgs, lens, (uint64_t)n, outs);
+    Py_END_ALLOW_THREADS
+  } else {
+    sha256_hash_batch(msgs, lens, (uint64_t)n, outs);
+  }
+
+  result = PyList_New(n);
+  for (Py_ssize_t i = 0; result != NULL && i < n; i++) {
+    PyObject* d = PyBytes_FromStringAndSize((const char*)digests + 32 * i, 32);
+    if (d == NULL) {
+      Py_CLEAR(result);
+      break;
+    }
+    PyList_SET_ITEM(result, i, d);
+  }
+
+done:
+  for (Py_ssize_t i = 0; i < got; i++) {
+    PyBuffer_Release(&views[i]);
+  }
+  PyMem_Free(views);
+  PyMem_Free(msgs);
+  PyMem_Free(lens);
+  PyMem_Free(outs);
+  PyMem_Free(digests);
+  Py_DECREF(seq);
+  return result;
+}
+
+// Offsets buffer as int32 or int64, from its format and item size.
+static int offsets_wide(const Py_buffer* view) {
+  const char* f = view->format != NULL ? view->format : "B";
+  char c = f[0] != '\0' && strchr("@=<>!", f[0]) != NULL ? f[1] : f[0];
+  if (view->ndim == 1 && view->itemsize == 8 && strchr("qlQL", c) != NULL) {
+    return 1;
+  }
+  if (view->ndim == 1 && view->itemsize == 4 && strchr("ilIL", c) != NULL) {
+    return 0;
+  }
+  PyErr_SetString(PyExc_TypeError, "offsets must be a 1-D int32 or int64 buffer");
+  return -1;
+}
+
+static int64_t offset_at(const void* offsets, int wide, Py_ssize_t i) {
+  return wide ? ((const int64_t*)offsets)[i] : ((const int32_t*)offsets)[i];
+}
+
+// hash_rows(data, offsets=None, *, width=0) -> bytes of N*32 digests.
+static PyObject* mod_hash_rows(PyObject* module, PyObject* args, PyObject* kwargs) {
+  (void)module;
+  static char* kwlist[] = { "data", "offsets", "width", NULL };
+  PyObject* data_obj;
+  PyObject* offsets_obj = Py_None;
+  Py_ssize_t width = 0;
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|O$n", kwlist, &data_obj, &offsets_obj,
+                                   &width)) {
+    return NULL;
+  }
+
+  Py_buffer data, offs = { 0 };
+  if (PyUnicode_Check(data_obj)) {
+    PyErr_SetString(PyExc_TypeError, "Strings must be encoded before hashing");
+    return NULL;
+  }
+  if (PyObject_GetBuffer(data_obj, &data, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) < 0) {
+    return NULL;
+  }
+  PyObject* result = NULL;
+  int64_t* fixed = NULL;
+  const void* offsets;
+  int wide;
+  Py_ssize_t n;
+
+  if (data.itemsize != 1) {
+    PyErr_SetString(PyExc_TypeError, "data must be a uint8 buffer");
+    goto done;
+  }
+  if (offsets_obj == Py_None) {
+    // Fixed-width rows: a 2-D array, or a flat buffer with width=.
+    if (data.ndim == 2 && width == 0) {
+      width = data.shape[1];
+      n = data.shape[0];
+    } else if (data.ndim <= 1 && width > 0 && data.len % width == 0) {
+      n = data.len / width;
+    } else {
+      PyErr_SetString(PyExc_ValueError,
+                      "data must be 2-D, or 1-D with a width that divides its length");
+      goto done;
+    }
+    fixed = PyMem_Malloc((size_t)(n + 1) * sizeof(*fixed));
+    if (fixed == NULL) {
+      PyErr_NoMemory();
+      goto done;
+    }
+    for (Py_ssize_t i = 0; i <= n; i++) {
+      fixed[i] = (int64_t)i * width;
+    }
+    offsets = fixed;
+    wide = 1;
+  } else {
+    if (width != 0) {
+      PyErr_SetString(PyExc_TypeError, "width and offsets are mutually exclusive");
+      goto done;
+    }
+    if (PyObject_GetBuffer(offsets_obj, &offs, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) < 0) {
+      goto done;
+    }
+    if ((wide = offsets_wide(&offs)) < 0) {
+      goto done;
+    }
+    n = offs.shape[0] - 1;
+    if (n < 0) {
+      PyErr_SetString(PyExc_ValueError, "offsets must hold nrows+1 entries");
+      goto done;
+    }
+    // The C engine trusts its offsets; check them here.
+    offsets = offs.buf;
+    for (Py_ssize_t i = 0; i <= n; i++) {
+      int64_t o = offset_at(offsets, wide, i);
+      if (o < 0 || o > data.len || (i > 0 && o < offset_at(offsets, wide, i - 1))) {
+        PyErr_Format(PyExc_ValueError, "offsets[%zd] out of order or out of range", i);
+        goto done;
+      }
+    }
+  }
+
+  result = PyBytes_FromStringAndSize(NULL, 32 * n);
+  if (result == NULL) {
+    goto done;
+  }
+  unsigned char* digests = (unsigned char*)PyBytes_AS_STRING(result);
+  int64_t total = n > 0 ? offset_at(offsets, wide, n) - offset_at(offsets, wide, 0) : 0;
+  if (total >= FASTSHA256_GIL_MINSIZE) {
+    Py_BEGIN_ALLOW_THREADS
+    if (wide) {
+      sha256_column64(offsets, data.buf, (uint64_t)n, digests);
+    } else {
+      sha256_column(offsets, data.buf, (uint64_t)n, digests);
+    }
+    Py_END_ALLOW_THREADS
+  } else if (wide) {
+    sha256_column64(offsets, data.buf, (uint64_t)n, digests);
+  } else {
+    sha256_column(offsets, data.buf, (uint64_t)n, digests);
+  }
+
+done:
+  PyMem_Free(fixed);
+  if (offs.obj != NULL) {
+    PyBuffer_Release(&offs);
+  }
+  PyBuffer_Release(&data);
+  return result;
+}
+
+static PyMethodDef module_methods[] = {
+  { "sha256", (PyCFunction)(void (*)(void))mod_sha256, METH_VARARGS | METH_KEYWORDS,
+    "sha256(data=b'', *, usedforsecurity=True) -> SHA-256 hash object" },
+  { "sha224", (PyCFunction)(void (*)(void))mod_sha224, METH_VARARGS | METH_KEYWORDS,
+    "sha224(data=b'', *, usedforsecurity=True) -> SHA-224 hash object" },
+  { "hash_batch", (PyCFunction)mod_hash_batch, METH_O,
+    "hash_batch(messages) -> list of SHA-256 digests, hashed in one call" },
+  { "hash_rows", (PyCFunction)(void (*)(void))mod_hash_rows, METH_VARARGS | METH_KEYWORDS,
+    "hash_rows(data, offsets=None, *, width=0) -> bytes of nrows*32 SHA-256 digests" },
+  { NULL, NULL, 0, NULL },
+};
+
+static struct PyModuleDef module_def = {
+  PyModuleDef_HEAD_INIT,
+  .m_name = "fastsha256",
+  .m_doc = "SHA-256 and SHA-224 backed by the SHA-NI and multi-buffer C kernels.",
+  .m_size = -1,
+  .m_methods = module_methods,
+};
+
+PyMODINIT_FUNC PyInit_fastsha256(void) {
+  if (PyType_Ready(&ShaType) < 0) {
+    return NULL;
+  }
+  PyObject* m = PyModule_Create(&module_def);
+  if (m == NULL) {
+    return NULL;
+  }
+  if (PyModule_AddIntConstant(m, "GIL_MINSIZE", FASTSHA256_GIL_MINSIZE) < 0) {
+    Py_DECREF(m);
+    return NULL;
+  }
+  return m;
+}
@@ -0,0 +1,221 @@
+"""treehash.py - Fingerprint files, directories or buffers on a process pool.
+
+    python3 treehash.py [-j jobs] [-c chunk] [-o manifest] path...
+
+Every regular file under the given paths is hashed and listed in a manifest,
+sorted by name, followed by a root digest over all entries:
+
+    # treehash v1 sha256 chunk=4194304
+    <digest>  <size>  <name>
+    ...
+    # root <digest>
+
+With chunk=0 each file is one task and <digest> is its plain SHA-256, as
+sha256sum prints it. With a chunk size, files are split into chunks hashed
+as separate tasks, so one large file also spreads over the pool, and
+<digest> is the Merkle root of its chunks. Names are relative to a
+directory argument, or as given for file arguments.
+
+The tree (chunks of a file, and manifest entries under the root) hashes
+leaves as SHA-256(0x00 || leaf) and nodes as SHA-256(0x01 || left || right);
+an odd node at the end of a level moves up unchanged.
+
+Workers are processes, so hashing scales across cores whatever the GIL does.
+They write digests straight into a table in multiprocessing.shared_memory
+instead of pickling results back; tree_hash_buffer() also places the input
+in shared memory once and each worker hashes its chunks there in place.
+Hashing uses the fastsha256 extension when it is built, else hashlib.
+"""
+from __future__ import annotations
+import argparse
+import os
+import sys
+from multiprocessing import Pool, shared_memory
+
+try:
+    from fastsha256 import sha256
+except ImportError:
+    from hashlib import sha256
+
+LEAF = b'\x00'
+NODE = b'\x01'
+READ_SIZE = 1 << 20
+
+# Worker state, set by _init() in each pool process.
+_digests = None
+_data = None
+_buf = None
+
+
+def _attach(name: str) -> shared_memory.SharedMemory:
+    """Open a segment created by the parent, which alone unlinks it."""
+    try:
+        return shared_memory.SharedMemory(name=name, track=False)
+    except TypeError:
+        # Before 3.13 attaching registers the name again, with the resource
+        # tracker pool workers share with the parent; the parent's unlink
+        # clears it.
+        return shared_memory.SharedMemory(name=name)
+
+
+def _init(digests_name: str, data_name: str | None) -> None:
+    global _digests, _data, _buf
+    _digests = _attach(digests_name)
+    _data = _attach(data_name) if data_name else None
+    _buf = bytearray(READ_SIZE)
+
+
+def _hash_file(task: tuple[int, str, int, int, bool]) -> None:
+    """Hash length bytes of path from offset into digest slot."""
+    slot, path, offset, length, leaf = task
+    h = sha256(LEAF) if leaf else sha256()
+    mv = memoryview(_buf)
+    with open(path, 'rb', buffering=0) as f:
+        f.seek(offset)
+        while length > 0:
+            n = f.readinto(mv[:min(length, READ_SIZE)])
+            if not n:
+                raise OSError(f"{path}: file shrank while hashing")
+            h.update(mv[:n])
+            length -= n
+    _digests.buf[32*slot:32*slot + 32] = h.digest()
+
+
+def _hash_range(task: tuple[int, int, int]) -> None:
+    """Hash the shared input buffer's [offset, offset+length) into slot."""
+    slot, offset, length = task
+    h = sha256(LEAF)
+    h.update(_data.buf[offset:offset + length])
+    _digests.buf[32*slot:32*slot + 32] = h.digest()
+
+
+def _run(fn, tasks: list, jobs: int, data: shared_memory.SharedMemory | None = None) -> list[bytes]:
+    """Run tasks (slot first) on jobs processes; return digests by slot."""
+    digests = shared_memory.SharedMemory(create=True, size=max(32 * len(tasks), 1))
+    try:
+        args = (digests.name, data.name if data else None)
+        if jobs <= 1 or len(tasks) <= 1:
+            _init(*args)
+            for t in tasks:
+                fn(t)
+            _digests.close()
+            if _data is not None:
+                _data.close()
+        else:
+            with Pool(min(jobs, len(tasks)), _init, args) as pool:
+                for _ in pool.imap_unordered(fn, tasks, max(1, len(tasks) // (jobs * 8))):
+                    pass
+        return [bytes(digests.buf[32*i:32*i + 32]) for i in range(len(tasks))]
+    finally:
+        digests.close()
+        digests.unlink()
+
+
+def merkle_root(leaves: list[bytes]) -> bytes:
+    """Root of leaf digests already hashed as SHA-256(0x00 || leaf)."""
+    level = list(leaves) or [sha256(LEAF).digest()]
+    while len(level) > 1:
+        up = [sha256(NODE + level[i] + level[i+1]).digest() for i in range(0, len(level) - 1, 2)]
+        if len(level) % 2:
+            up.append(level[-1])
+        level = up
+    return level[0]
+
+
+def _chunks(size: int, chunk: int) -> list[tuple[int, int]]:
+    if chunk <= 0:
+        return [(0, size)]
+    return [(off, min(chunk, size - off)) for off in range(0, size, chunk)] or [(0, 0)]
+
+
+def tree_hash_buffer(data, chunk: int = 1 << 22, jobs: int | None = None) -> tuple[bytes, list[bytes]]:
+    """Merkle root and chunk leaves of an in-memory buffer.
+
+    :param data: Bytes-like object; copied once into shared memory.
+    :param chunk: Chunk size in bytes.
+    :param jobs: Worker processes, default one per CPU.
+    :return: (root digest, leaf digests in order).
+    """
+    mv = memoryview(data).cast('B')
+    shm = shared_memory.SharedMemory(create=True, size=max(len(mv), 1))
+    try:
+        shm.buf[:len(mv)] = mv
+        tasks = [(i, off, n) for i, (off, n) in enumerate(_chunks(len(mv), chunk))]
+        leaves = _run(_hash_range, tasks, jobs or os.cpu_count() or 1, shm)
+    finally:
+        shm.close()
+        shm.unlink()
+    return merkle_root(leaves), leaves
+
+
+def list_files(paths: list[str]) -> list[tuple[str, str, int]]:
+    """(name, path, size) of every regular file under paths, sorted by name."""
+    out = []
+    for p in paths:
+        if os.path.isdir(p):
+            for root, dirs, files in os.walk(p):
+                dirs.sort()
+                for f in files:
+                    full = os.path.join(root, f)
+                    if os.path.isfile(full):
+                        name = os.path.relpath(full, p).replace(os.sep, '/')
+                        out.append((name, full, os.path.getsize(full)))
+        else:
+            out.append((p.replace(os.sep, '/'), p, os.path.getsize(p)))
+    out.sort(key=lambda e: e[0].encode('utf-8', 'surrogateescape'))
+    return out
+
+
+def manifest(paths: list[str], chunk: int = 0, jobs: int | None = None) -> tuple[str, bytes]:
+    """Manifest text and root digest for the files under paths.
+
+    :param paths: Files and directories.
+    :param chunk: Chunk size in bytes, or 0 to hash each file whole.
+    :param jobs: Worker processes, default one per CPU.
+    :return: (manifest, root digest).
+    """
+    files = list_files(paths)
+    tasks = []
+    spans = []  # Slots of each file's chunks.
+    for _, path, size in files:
+        first = len(tasks)
+        for off, n in _chunks(size, chunk):
+            tasks.append((len(tasks), path, off, n, chunk > 0))
+        spans.append((first, len(tasks)))
+    # Largest first, so a big file does not start last and run alone.
+    tasks.sort(key=lambda t: -t[3])
+    digests = _run(_hash_file, tasks, jobs or os.cpu_count() or 1)
+
+    lines = [f"# treehash v1 sha256 chunk={chunk}"]
+    leaves = []
+    for (name, _, size), (first, end) in zip(files, spans):
+        d = digests[first] if chunk <= 0 else merkle_root(digests[first:end])
+        name = name.replace('\\', '\\\\').replace('\n', '\\n')
+        entry = f"{d.hex()}  {size}  {name}"
+        lines.append(entry)
+        leaves.append(sha256(LEAF + entry.encode('utf-8', 'surrogateescape')).digest())
+    root = merkle_root(leaves)
+    lines.append(f"# root {root.hex()}")
+    return '\n'.join(lines) + '\n', root
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Hash files into a manifest and root digest.")
+    ap.add_argument('paths', nargs='+', help="files and directories")
+    ap.add_argument('-j', '--jobs', type=int, default=os.cpu_count(), help="worker processes")
+    ap.add_argument('-c', '--chunk', type=int, default=0,
+                    help="split files into chunks of this many bytes (0: whole files)")
+    ap.add_argument('-o', '--output', help="write the manifest here instead of stdout")
+    args = ap.parse_args()
+
+    text, root = manifest(args.paths, args.chunk, args.jobs)
+    if args.output:
+        with open(args.output, 'w', encoding='utf-8', errors='surrogateescape') as f:
+            f.write(text)
+        print(root.hex())
+    else:
+        sys.stdout.write(text)
+
+
+if __name__ == '__main__':
+    main()